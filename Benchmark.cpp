@@ -0,0 +1,264 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "Generator.h"
+#include "Td6.h"
+
+/*
+ * Constants
+ */
+
+// Every run uses one of these grids and minimum lengths, with seeds 1 to
+// kDefaultSeeds unless overridden.
+constexpr int kBenchmarkSizes[][3] = {
+  {kSizeY, kSizeX, kSizeZ},
+  {16, 16, 16},
+  {24, 24, 16},
+};
+constexpr int kBenchmarkLengths[] = {60, 100, 120};
+// The maximum length is this much longer than the minimum.
+constexpr int kLengthSlack = 60;
+constexpr int kDefaultSeeds = 10;
+// Memory the beam search may use for its tracks.
+constexpr size_t kBeamMemory = 256 << 20;
+// A depth-first run with warm tables allocates its workers' buffers up front
+// and nothing per node or attempt. Runs that allocate more than this, per
+// worker, fail the benchmark.
+constexpr uint64_t kAllocationsPerWorker = 16;
+// Checked before any run: the TD6 codec must read it and write it back
+// unchanged. Relative to the repository, where the benchmark is run from.
+constexpr char kTemplateTd6[] = "template.td6";
+
+/*
+ * Declarations
+ */
+
+long PeakMemoryKb();
+void *operator new(size_t size);
+void *operator new(size_t size, const std::nothrow_t&) noexcept;
+void operator delete(void *pointer) noexcept;
+void operator delete(void *pointer, size_t size) noexcept;
+
+/*
+ * Definitions
+ */
+
+// Heap allocations of the process so far, counted by operator new. The
+// search allocates its tables and frames up front, so the count of a run
+// shouldn't grow with its nodes.
+std::atomic<uint64_t> allocations;
+
+// Highest resident set size of the process so far. It never goes down, so
+// only growth between runs is attributable to a run.
+long PeakMemoryKb() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+void *operator new(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  void *pointer = std::malloc(size == 0 ? 1 : size);
+  if (pointer == nullptr) {
+    throw std::bad_alloc();
+  }
+  return pointer;
+}
+
+// std::stable_sort and friends allocate their buffers with this one.
+void *operator new(size_t size, const std::nothrow_t&) noexcept {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  return std::malloc(size == 0 ? 1 : size);
+}
+
+void operator delete(void *pointer) noexcept {
+  std::free(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept {
+  std::free(pointer);
+}
+
+/*
+ * Main
+ */
+
+// Usage: Benchmark [--seeds N] [--threads N] [--work-stealing]
+//   [--restarts fixed|luby|geometric] [--partial-restarts] [--backjumping]
+//   [--min-climb LEVELS] [--connectors] [--beam WIDTH] [--mcts SECONDS]
+//
+// Prints one JSON object per run, then one per configuration with the totals,
+// so the output can be diffed or collected over time. Runs are only
+// reproducible with a single thread, which is the default.
+//
+// Fails if a depth-first run allocates more than kAllocationsPerWorker per
+// worker. The first run of every configuration is left out, it may be the one
+// that builds the tables. Work stealing, beam search and MCTS allocate per
+// work item, beam node and tree node, so they aren't checked.
+int main(int argc, const char** argv)
+{
+  int seeds = kDefaultSeeds;
+  int threads = 1;
+  ParallelMode parallelMode = kPortfolio;
+  RestartPolicy restartPolicy = kRestartLuby;
+  bool partialRestarts = false;
+  bool backjumping = false;
+  float minimumClimb = kMinimumClimb;
+  bool closingConnectors = false;
+  SearchEngine engine = kEngineDepthFirst;
+  int beamWidth = 0;
+  double mctsSeconds = 0;
+  bool allocationsBounded = true;
+  bool valid = true;
+  for (int i = 1; i < argc && valid; ++i) {
+    std::string arg = argv[i];
+    int left = argc - i - 1;
+    if (arg == "--seeds" && left >= 1) {
+      seeds = std::atoi(argv[++i]);
+      valid = seeds >= 1;
+    } else if (arg == "--threads" && left >= 1) {
+      threads = std::atoi(argv[++i]);
+      valid = threads >= 0;
+    } else if (arg == "--work-stealing") {
+      parallelMode = kWorkStealing;
+    } else if (arg == "--restarts" && left >= 1) {
+      std::string policy = argv[++i];
+      restartPolicy = policy == "luby" ? kRestartLuby
+        : policy == "geometric" ? kRestartGeometric : kRestartFixed;
+      valid = policy == "luby" || policy == "geometric" || policy == "fixed";
+    } else if (arg == "--partial-restarts") {
+      partialRestarts = true;
+    } else if (arg == "--backjumping") {
+      backjumping = true;
+    } else if (arg == "--min-climb" && left >= 1) {
+      minimumClimb = std::atof(argv[++i]);
+      valid = minimumClimb >= 0;
+    } else if (arg == "--connectors") {
+      closingConnectors = true;
+    } else if (arg == "--beam" && left >= 1) {
+      engine = kEngineBeam;
+      beamWidth = std::atoi(argv[++i]);
+      valid = beamWidth >= 1;
+    } else if (arg == "--mcts" && left >= 1) {
+      engine = kEngineMcts;
+      mctsSeconds = std::atof(argv[++i]);
+      valid = mctsSeconds > 0;
+    } else {
+      valid = false;
+    }
+  }
+  if (!valid) {
+    std::cout << "Usage: " << argv[0]
+      << " [--seeds N] [--threads N] [--work-stealing]"
+      << " [--restarts fixed|luby|geometric] [--partial-restarts]"
+      << " [--backjumping] [--min-climb LEVELS] [--connectors]"
+      << " [--beam WIDTH] [--mcts SECONDS]" << std::endl;
+    return -1;
+  }
+
+  if (!CheckTd6RoundTrip(kTemplateTd6)) {
+    return 1;
+  }
+
+  uint64_t workers =
+    threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+  for (const auto& size : kBenchmarkSizes) {
+    for (int length : kBenchmarkLengths) {
+      GeneratorOptions options = {
+        .sizeY = size[0],
+        .sizeX = size[1],
+        .sizeZ = size[2],
+        .minimumTrackSize = static_cast<size_t>(length),
+        .maximumTrackSize = static_cast<size_t>(length + kLengthSlack),
+        .tryPerAttempt = kTryPerAttempt,
+        .restartPolicy = restartPolicy,
+        .partialRestarts = partialRestarts,
+        .backjumping = backjumping,
+        .minimumClimb = minimumClimb,
+        .threads = threads,
+        .parallelMode = parallelMode,
+        .closingConnectors = closingConnectors,
+        .engine = engine,
+        .beamWidth = beamWidth,
+        .beamMemory = kBeamMemory,
+        .mctsSeconds = mctsSeconds,
+      };
+
+      std::vector<double> times;
+      uint64_t totalNodes = 0;
+      int totalAttempts = 0;
+      uint64_t totalAllocations = 0;
+      for (int seed = 1; seed <= seeds; ++seed) {
+        options.seed = seed;
+        GeneratorStats stats;
+        uint64_t allocationsBefore = allocations;
+        auto start = std::chrono::steady_clock::now();
+        GeneratorResult result = Generate(options, &stats);
+        std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+
+        uint64_t runAllocations = allocations - allocationsBefore;
+        bool checked = seed > 1 && engine == kEngineDepthFirst
+          && parallelMode == kPortfolio;
+        if (checked && runAllocations > kAllocationsPerWorker * workers) {
+          std::cerr << "Seed " << seed << " allocated " << runAllocations
+            << " times for " << stats.nodes << " nodes" << std::endl;
+          allocationsBounded = false;
+        }
+
+        times.push_back(elapsed.count());
+        totalAllocations += runAllocations;
+        totalNodes += stats.nodes;
+        totalAttempts += stats.attempts;
+        std::cout << "{\"size\": [" << size[0] << ", " << size[1] << ", "
+          << size[2] << "], \"minimumLength\": " << length
+          << ", \"seed\": " << seed
+          << ", \"pieces\": " << result.tracks.size()
+          << ", \"excitement\": " << result.ratings.excitement
+          << ", \"intensity\": " << result.ratings.intensity
+          << ", \"nausea\": " << result.ratings.nausea
+          << ", \"attempts\": " << stats.attempts
+          << ", \"nodes\": " << stats.nodes
+          << ", \"backtracks\": " << stats.backtracks
+          << ", \"deadStateHits\": " << stats.deadStateHits
+          << ", \"backjumps\": " << stats.backjumps
+          << ", \"seconds\": " << elapsed.count()
+          << ", \"nodesPerSecond\": " << stats.nodes / elapsed.count()
+          << ", \"allocations\": " << runAllocations
+          << ", \"peakMemoryKb\": " << PeakMemoryKb();
+        if (kProfile) {
+          std::cout << ", \"stats\": ";
+          WriteStatsJson(stats, &std::cout);
+        }
+        std::cout << "}" << std::endl;
+      }
+
+      double total = 0;
+      for (double time : times) {
+        total += time;
+      }
+      std::sort(times.begin(), times.end());
+      std::cout << "{\"size\": [" << size[0] << ", " << size[1] << ", "
+        << size[2] << "], \"minimumLength\": " << length
+        << ", \"runs\": " << seeds
+        << ", \"attempts\": " << totalAttempts
+        << ", \"nodes\": " << totalNodes
+        << ", \"allocations\": " << totalAllocations
+        << ", \"seconds\": " << total
+        << ", \"medianSeconds\": " << times[times.size() / 2]
+        << ", \"maxSeconds\": " << times.back()
+        << ", \"nodesPerSecond\": " << totalNodes / total << "}" << std::endl;
+    }
+  }
+  return allocationsBounded ? 0 : 1;
+}
@@ -0,0 +1,4035 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <random>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <openrct2/ride/Track.h>
+
+#include "Generator.h"
+
+/*
+ * Constants
+ */
+
+// In bidirectional mode, tracks of up to this many pieces are grown backwards
+// from the end.
+constexpr int kBackwardDepth = 5;
+// The connector library has every track of up to this many pieces, see
+// ConnectorLibrary.
+constexpr int kConnectorDepth = 4;
+// Connectors are enumerated on a grid this wide around the origin, enough for
+// kConnectorDepth of the largest pieces in any direction.
+constexpr int kConnectorSpan = 64;
+
+// Bump whenever the layout of the table cache or the way any cached table is
+// computed changes, so stale caches are rebuilt. See TableCacheHeader.
+constexpr uint32_t kTableCacheVersion = 1;
+constexpr char kTableCacheMagic[8] = "RCTGEN\x1a";
+// Sections of the table cache start at multiples of this.
+constexpr size_t kTableCacheAlignment = 64;
+
+// Entries in each search's table of dead states, a power of two. 0 disables
+// the table.
+constexpr int kDeadStateTableSize = 1 << 16;
+// The search looks at the clock for GeneratorOptions::timeLimit every this
+// many backtracks, a power of two.
+constexpr uint64_t kDeadlineInterval = 1 << 10;
+
+// Undo log entries reserved per frame. A piece writes two per row of its
+// shape, most take a few rows; the log only grows past this on long pieces.
+constexpr int kUndoEntriesPerFrame = 16;
+
+// Capacities of the dense tables compiled by CompileTables().
+constexpr int kMaxTrackTypes = 256;
+constexpr int kMaxPieces = 128;
+constexpr int kMaxShapeRows = 4096;
+constexpr int kMaxSuccessorLists = 32;
+constexpr int kMaxSuccessors = 16;
+
+// Marks states of the closing distance table that can't reach the end, or
+// only in more pieces than the byte holds. The search for distances stops at
+// kUnreachable - 1, which is still sound: a state further away than that
+// can't close within kMaxTrackSize pieces anyway.
+constexpr uint8_t kUnreachable = 0xFF;
+static_assert(kMaxTrackSize < kUnreachable,
+  "Tracks must be shorter than the longest closing distance");
+
+// Vertical loops are picked this much more often than other pieces, unless
+// GeneratorOptions::trackWeights says otherwise.
+constexpr float kLoopWeight = 16;
+// Weighted picks draw from the full alias table this many times, skipping
+// failed candidates, before falling back to a scan of the remaining ones.
+constexpr int kAliasTries = 4;
+
+// The speed model measures the train's speed as the number of grid levels it
+// could still climb. The station launches it to kLaunchClimb, a lift hill
+// pulls it up at kLiftClimb, and every tile it rolls over costs
+// kFrictionPerTile.
+constexpr float kLaunchClimb = 16;
+constexpr float kLiftClimb = 1;
+constexpr float kFrictionPerTile = 0.03;
+// Track flag of lift hill pieces.
+constexpr uint8_t kLiftFlag = 0x80;
+
+// Weights of the rating estimate: each rating is a base plus a weight per
+// tile, inversion, banked turn, drop and level of the highest drop. Rough fits
+// to the game's ratings of generated coasters, not its actual formula.
+constexpr RideRatings kRatingBase = {1.5, 1.5, 1.0};
+constexpr RideRatings kRatingPerTile = {0.008, 0.004, 0.002};
+constexpr RideRatings kRatingPerInversion = {0.45, 0.6, 0.4};
+constexpr RideRatings kRatingPerTurn = {0.05, 0.08, 0.06};
+constexpr RideRatings kRatingPerDrop = {0.15, 0.1, 0.05};
+constexpr RideRatings kRatingPerDropLevel = {0.12, 0.2, 0.08};
+// Like in the game, intensity above this spoils the excitement.
+constexpr float kMaxEnjoyableIntensity = 10;
+
+// Beam scores get a random bonus of up to this much, so ties are broken at
+// random and the attempts after a failed one differ.
+constexpr float kBeamJitter = 0.1;
+// At most this many tracks of a beam extend the same shorter track, so one
+// good prefix can't crowd out all the others.
+constexpr int kBeamChildren = 2;
+
+// Weight of exploration in the Monte Carlo search's upper confidence bound,
+// with rewards scaled by the best one so far.
+constexpr double kMctsExploration = 0.7;
+// Backtracks a Monte Carlo rollout may take to close the circuit.
+constexpr int kMctsRolloutBudget = 200;
+// The tree stops growing at this many nodes, rollouts go on from its leaves.
+constexpr uint32_t kMctsMaxNodes = 1 << 22;
+
+// Budgets of kRestartGeometric grow by this factor per attempt.
+constexpr double kRestartGrowth = 1.2;
+// Budgets are capped so shared step counters can't overflow.
+constexpr int kMaxAttemptBudget = 1 << 30;
+// Partial restarts rewind to a frame in the first 1 / kCheckpointFraction of
+// the pieces placed after the initial track.
+constexpr int kCheckpointFraction = 4;
+
+/*
+ * Types
+ */
+
+enum DirectionType { kNorth, kEast, kSouth, kWest };
+
+// The search is compiled once per grid type, so with a FixedGrid the bounds
+// checks and grid indexing fold to constants.
+//
+// Occupancy is packed 4 bits per tile (one bit per quarter), so a row of tiles
+// along x takes `wordsPerRow` 64-bit words. The grid has one extra word of
+// padding, see AddTrackToSpace().
+template <int kY, int kX, int kZ>
+struct FixedGrid {
+  static constexpr int sizeY = kY;
+  static constexpr int sizeX = kX;
+  static constexpr int sizeZ = kZ;
+  static constexpr int wordsPerRow = (sizeX * 4 + 63) / 64;
+  static constexpr int numWords = wordsPerRow * sizeY * sizeZ + 1;
+};
+
+// Any other size, set by Generate() before searching.
+struct DynamicGrid {
+  static inline int sizeY;
+  static inline int sizeX;
+  static inline int sizeZ;
+  static inline int wordsPerRow;
+  static inline int numWords;
+};
+
+DirectionType TurnLeft(DirectionType dir);
+DirectionType TurnRight(DirectionType dir);
+
+struct Coord {
+  // Yes, the order is y, x, z. Don't ask.
+  int y;
+  int x;
+  int z;
+};
+
+struct Cell {
+  int c00;
+  int c01;
+  int c10;
+  int c11;
+};
+
+struct TrackCell {
+  Coord coord;
+  Cell cell;
+};
+
+struct TrackPiece {
+  std::vector<TrackCell> shape;
+  Coord ptr;
+};
+
+// Compact index of a track type in PieceTables.
+using piece_id_t = uint8_t;
+constexpr piece_id_t kNoPiece = 0xFF;
+
+// One row of a track piece in packed form: the quarters it occupies at height
+// `z` and row `y` (relative to the piece), starting at the piece's lowest x.
+struct SpaceRow {
+  int8_t y;
+  int8_t z;
+  uint32_t mask;
+};
+
+// A rotated track piece compiled to row masks, so placing it is a handful of
+// AND/OR operations instead of one branchy check per quarter. The rows are
+// `PieceTables::shapeRows[firstRow, firstRow + numRows)`.
+struct CompiledPiece {
+  Coord ptr;
+  Coord min;
+  Coord max;
+  uint16_t firstRow;
+  uint16_t numRows;
+};
+
+// Flat tables compiled once from the maps below, so the hot path only does
+// array lookups. Track types are renumbered to piece ids, and the vectors of
+// trackStateMachine to successor list ids (list 0 is empty).
+struct PieceTables {
+  int numPieces;
+  int numShapeRows;
+  int numSuccessorLists;
+  piece_id_t pieceIds[kMaxTrackTypes];
+  track_type_t types[kMaxPieces];
+  uint8_t turns[kMaxPieces];
+  uint8_t successorLists[kMaxPieces];
+  CompiledPiece pieces[kMaxPieces][4];
+  SpaceRow shapeRows[kMaxShapeRows];
+  uint8_t numSuccessors[kMaxSuccessorLists];
+  piece_id_t successors[kMaxSuccessorLists][kMaxSuccessors];
+  // For the speed model: the highest level the train reaches on each piece,
+  // relative to where it enters, and the number of tiles it rolls over.
+  int8_t peaks[kMaxPieces];
+  uint8_t lengths[kMaxPieces];
+  // Inversions of each piece, for the rating estimate.
+  uint8_t inversions[kMaxPieces];
+};
+
+// What the rating estimate of a path is based on, see AddFeatures().
+struct RideFeatures {
+  uint16_t length;
+  uint16_t inversions;
+  uint16_t turns;
+  uint16_t drops;
+  // Levels of the drop in progress, and of the highest one.
+  uint16_t drop;
+  uint16_t maxDrop;
+};
+
+// Bits set in a word while placing a track piece, so they can be cleared when
+// the search backtracks.
+struct UndoEntry {
+  int index;
+  uint64_t bits;
+};
+
+// The occupancy grid shared by the whole search, 4 bits per tile. Every write
+// is recorded in the undo log, so backtracking only reverts the words the last
+// pieces touched.
+struct Space {
+  std::vector<uint64_t> words;
+  std::vector<UndoEntry> undoLog;
+  // Zobrist hash of the occupied bits, see OccupancyHash().
+  uint64_t hash;
+  // With backjumping, the stack depth of the piece that set each bit,
+  // indexed by word * 64 + bit, or 0 for the reserved tiles. Stale for
+  // cleared bits.
+  std::vector<uint16_t> owners;
+};
+
+// Per-depth search state. The track pieces themselves live in a single path
+// vector shared by the whole search, where frame i + 1 was reached by
+// placing path[i].
+struct GeneratorInfo {
+  size_t undoOffset;
+  Coord ptr;
+  DirectionType dir;
+  // Bit i is set once successor i of the frame's successor list failed or was
+  // handed to another worker. See SuccessorIndex().
+  uint16_t failedTracks;
+  // Whether the bidirectional search already tried to close from here, and
+  // whether a connector did.
+  bool closingTried;
+  bool connectorTried;
+  // Whether some candidates of this frame or a frame above it were donated to
+  // another worker or skipped by a backjump, so running out of candidates
+  // doesn't prove it dead.
+  bool incomplete;
+  // See StateKey().
+  uint64_t stateKey;
+  // Levels the train could still climb at the end of the path, see
+  // kLaunchClimb.
+  float energy;
+  RideFeatures features;
+};
+
+// A state with no completion for a train of up to `energy`, see StateKey().
+struct DeadState {
+  uint64_t key;
+  float energy;
+};
+
+// xoshiro256** state, see NextRandom().
+struct Random {
+  uint64_t state[4];
+};
+
+// Weights of the successors of every list, compiled to Walker alias tables:
+// slot i of a list is picked with `probability` and otherwise gives way to
+// `alias`. See PickWeightedTrack().
+struct TrackWeights {
+  float weights[kMaxSuccessorLists][kMaxSuccessors];
+  float probability[kMaxSuccessorLists][kMaxSuccessors];
+  uint8_t alias[kMaxSuccessorLists][kMaxSuccessors];
+  // Bit i is set if successor i has a positive weight.
+  uint16_t enabled[kMaxSuccessorLists];
+};
+
+// Everything one randomized search owns. Parallel workers each have their
+// own, only the compiled tables and weights are shared.
+struct Search {
+  const GeneratorOptions *options;
+  const TrackWeights *weights;
+  Space space;
+  std::vector<GeneratorInfo> stack;
+  std::vector<TrackDesignTrackElement> path;
+  Random random;
+  // Lossy table of states known to have no completion. Unlike the rest of the
+  // search it's kept across attempts.
+  std::vector<DeadState> deadStates;
+  // With backjumping, the depths of the pieces blamed for the failures below
+  // each frame, a bitset of `conflictWords` words per frame. See Backtrack().
+  std::vector<uint64_t> conflicts;
+  int conflictWords;
+  // The depth blamed for the last piece AddTrackToStack() turned down.
+  size_t blocker;
+  // Counters of this search, except for the attempts.
+  GeneratorStats stats;
+};
+
+// A track grown backwards from the end: `length` pieces starting at
+// `BackwardTracks::pieces[first]`, entered at `ptr` facing `dir`.
+struct BackwardTrack {
+  Coord ptr;
+  DirectionType dir;
+  uint32_t first;
+  uint32_t length;
+};
+
+// Every backward track of up to kBackwardDepth pieces, indexed by the forward
+// search state it can be joined to: the tracks that can follow a forward
+// path ending in state i are `trackIds[stateOffsets[i], stateOffsets[i + 1])`,
+// where i is the state's DistanceIndex().
+struct BackwardTracks {
+  std::vector<piece_id_t> pieces;
+  std::vector<BackwardTrack> tracks;
+  std::vector<uint32_t> stateOffsets;
+  std::vector<uint32_t> trackIds;
+};
+
+// A track of up to kConnectorDepth pieces that doesn't collide with itself:
+// `length` indices into successor lists, starting at
+// `ConnectorLibrary::steps[first]`. The first indexes the list of the state
+// the track starts from, every other one the list of the piece before it.
+struct Connector {
+  // See ConnectorKey().
+  uint32_t key;
+  uint32_t first;
+  uint32_t length;
+};
+
+// Every connector, sorted by the relative pose it goes between. It doesn't
+// depend on the grid, so it's built once, like the tables, and closing the
+// circuit from any state is a lookup plus an occupancy check of the pieces.
+// The arrays are either built in memory or mapped from the table cache.
+struct ConnectorLibrary {
+  const Connector *connectors;
+  size_t numConnectors;
+  const uint8_t *steps;
+  size_t numSteps;
+};
+
+// A table cache file starts with this header, which gives the offset of each
+// section from the start of the file: the PieceTables, the closing distances
+// of the grid and the connector library. Files are named after `key`, see
+// TableCacheKey().
+struct TableCacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t headerSize;
+  uint64_t key;
+  uint64_t fileSize;
+  uint64_t tablesOffset;
+  uint64_t tablesSize;
+  uint64_t distancesOffset;
+  uint64_t numDistances;
+  uint64_t connectorsOffset;
+  uint64_t numConnectors;
+  uint64_t stepsOffset;
+  uint64_t numSteps;
+};
+
+// The connectors are enumerated on this grid, starting in the middle.
+using ConnectorGrid = FixedGrid<kConnectorSpan, kConnectorSpan, kConnectorSpan>;
+constexpr Coord kConnectorOrigin = {
+  kConnectorSpan / 2, kConnectorSpan / 2, kConnectorSpan / 2};
+
+// Shared by the workers of one Generate() call. The first worker to succeed
+// sets `done`, which cancels the others.
+struct Portfolio {
+  std::atomic<bool> done;
+  std::atomic<int> attempts;
+  std::mutex mutex;
+  GeneratorResult result;
+  // Reward of the result, kEngineMcts replaces it whenever it finds a better
+  // coaster.
+  float resultReward;
+  // Only built in bidirectional mode.
+  const BackwardTracks *backwardTracks;
+  // Only used with GeneratorOptions::closingConnectors.
+  const ConnectorLibrary *connectors;
+  // From GeneratorOptions::timeLimit, or the end of time without one.
+  std::chrono::steady_clock::time_point deadline;
+};
+
+// Untried candidates of one frame, handed from a busy worker to an idle one.
+// `prefix` is the path that leads to the frame.
+struct WorkItem {
+  std::vector<TrackDesignTrackElement> prefix;
+  std::vector<track_type_t> candidates;
+};
+
+// One attempt split between workers. Idle workers raise `hungry`, busy
+// workers notice it at their next step and donate part of their shallowest
+// frame. The attempt is over once every worker is idle with no items left,
+// the shared step budget runs out, or a coaster is found.
+struct WorkPool {
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<WorkItem> items;
+  std::atomic<int> hungry;
+  std::atomic<int> steps;
+  // Steps of the attempt, see AttemptBudget().
+  int budget;
+  int workers;
+  int idle;
+  bool stopped;
+};
+
+// A partial track kept by the beam search: its last piece, and the node of
+// the track without it. Tracks share their prefixes, and only the nodes of
+// tracks that made it into a beam are stored.
+struct BeamNode {
+  uint32_t parent;
+  track_type_t type;
+};
+
+// A track one piece longer than a node of the beam.
+struct BeamCandidate {
+  float score;
+  // GeneratorInfo::stateKey and the train's speed, see BeamKey(). Tracks with
+  // the same one have the same futures.
+  uint64_t key;
+  uint32_t parent;
+  track_type_t type;
+};
+
+// The parent of the tracks right after the initial track.
+constexpr uint32_t kNoBeamNode = 0xFFFFFFFF;
+
+// Scores the track on top of the search's stack, higher is better.
+using ScoreFunction = float (*)(const Search& search);
+
+// A partial track in the Monte Carlo search's tree: its last piece and its
+// parent. The children are added all at once, they are
+// `MctsTree::nodes[firstChild, firstChild + numChildren)`.
+struct MctsNode {
+  uint32_t parent = 0;
+  uint32_t firstChild = 0;
+  track_type_t type = 0;
+  uint8_t numChildren = 0;
+  bool expanded = false;
+  // The track closes the circuit, so it has no children.
+  bool closed = false;
+  // No rollout through the node can close the circuit.
+  bool dead = false;
+  uint32_t visits = 0;
+  // Rollouts through the node still running. They count as visits without a
+  // reward, so other workers are steered to other nodes meanwhile.
+  uint32_t virtualLoss = 0;
+  double totalReward = 0;
+};
+
+// Shared by the Monte Carlo workers. Node 0 is the initial track.
+struct MctsTree {
+  std::mutex mutex;
+  std::vector<MctsNode> nodes;
+  float bestReward;
+  std::chrono::steady_clock::time_point deadline;
+};
+
+enum SearchResult {
+  kSearchFound,
+  // Every candidate below the search root failed.
+  kSearchExhausted,
+  // Out of steps, or another worker finished.
+  kSearchStopped,
+};
+
+/*
+ * Declarations
+ */
+
+std::map<track_type_t, DirectionType (*)(DirectionType)> dirStateMachine = {
+  {TRACK_ELEM_BANKED_RIGHT_QUARTER_TURN_5_TILES, &TurnRight},
+  {TRACK_ELEM_RIGHT_BANKED_QUARTER_TURN_5_TILE_25_DEG_UP, &TurnRight},
+  {TRACK_ELEM_RIGHT_BANKED_QUARTER_TURN_5_TILE_25_DEG_DOWN, &TurnRight},
+  {TRACK_ELEM_RIGHT_QUARTER_TURN_3_TILES_BANK, &TurnRight},
+  {TRACK_ELEM_RIGHT_BANKED_QUARTER_TURN_3_TILE_25_DEG_UP, &TurnRight},
+  {TRACK_ELEM_RIGHT_QUARTER_TURN_1_TILE_60_DEG_UP, &TurnRight},
+  {TRACK_ELEM_RIGHT_BANKED_QUARTER_TURN_3_TILE_25_DEG_DOWN, &TurnRight},
+  {TRACK_ELEM_RIGHT_QUARTER_TURN_1_TILE_60_DEG_DOWN, &TurnRight},
+  {TRACK_ELEM_BANKED_LEFT_QUARTER_TURN_5_TILES, &TurnLeft},
+  {TRACK_ELEM_LEFT_BANKED_QUARTER_TURN_5_TILE_25_DEG_UP, &TurnLeft},
+  {TRACK_ELEM_LEFT_BANKED_QUARTER_TURN_5_TILE_25_DEG_DOWN, &TurnLeft},
+  {TRACK_ELEM_LEFT_QUARTER_TURN_3_TILES_BANK, &TurnLeft},
+  {TRACK_ELEM_LEFT_BANKED_QUARTER_TURN_3_TILE_25_DEG_UP, &TurnLeft},
+  {TRACK_ELEM_LEFT_QUARTER_TURN_1_TILE_60_DEG_UP, &TurnLeft},
+  {TRACK_ELEM_LEFT_BANKED_QUARTER_TURN_3_TILE_25_DEG_DOWN, &TurnLeft},
+  {TRACK_ELEM_LEFT_QUARTER_TURN_1_TILE_60_DEG_DOWN, &TurnLeft},
+  // Only used for initial coaster.
+  {TRACK_ELEM_RIGHT_QUARTER_TURN_3_TILES, &TurnRight},
+  {TRACK_ELEM_LEFT_QUARTER_TURN_3_TILES, &TurnLeft},
+};
+
+std::vector<track_type_t> statesForTrackElemFlat = {
+  TRACK_ELEM_FLAT,
+  TRACK_ELEM_FLAT_TO_LEFT_BANK,
+  TRACK_ELEM_FLAT_TO_RIGHT_BANK,
+  TRACK_ELEM_FLAT_TO_25_DEG_UP,
+  TRACK_ELEM_FLAT_TO_LEFT_BANKED_25_DEG_UP,
+  TRACK_ELEM_FLAT_TO_RIGHT_BANKED_25_DEG_UP,
+  TRACK_ELEM_FLAT_TO_25_DEG_DOWN,
+  TRACK_ELEM_FLAT_TO_LEFT_BANKED_25_DEG_DOWN,
+  TRACK_ELEM_FLAT_TO_RIGHT_BANKED_25_DEG_DOWN,
+};
+std::vector<track_type_t> statesForTrackElementLeftBank = {
+  TRACK_ELEM_LEFT_BANK,
+  TRACK_ELEM_LEFT_BANK_TO_FLAT,
+  TRACK_ELEM_LEFT_BANK_TO_25_DEG_UP,
+  TRACK_ELEM_LEFT_BANK_TO_25_DEG_DOWN,
+  TRACK_ELEM_LEFT_BANKED_FLAT_TO_LEFT_BANKED_25_DEG_UP,
+  TRACK_ELEM_LEFT_BANKED_FLAT_TO_LEFT_BANKED_25_DEG_DOWN,
+  TRACK_ELEM_BANKED_LEFT_QUARTER_TURN_5_TILES,
+  TRACK_ELEM_LEFT_QUARTER_TURN_3_TILES_BANK,
+};
+std::vector<track_type_t> statesForTrackElementRightBank = {
+  TRACK_ELEM_RIGHT_BANK,
+  TRACK_ELEM_RIGHT_BANK_TO_FLAT,
+  TRACK_ELEM_RIGHT_BANK_TO_25_DEG_UP,
+  TRACK_ELEM_RIGHT_BANK_TO_25_DEG_DOWN,
+  TRACK_ELEM_RIGHT_BANKED_FLAT_TO_RIGHT_BANKED_25_DEG_UP,
+  TRACK_ELEM_RIGHT_BANKED_FLAT_TO_RIGHT_BANKED_25_DEG_DOWN,
+  TRACK_ELEM_BANKED_RIGHT_QUARTER_TURN_5_TILES,
+  TRACK_ELEM_RIGHT_QUARTER_TURN_3_TILES_BANK,
+};
+std::vector<track_type_t> statesForTrackElem25DegUp = {
+  TRACK_ELEM_25_DEG_UP_TO_FLAT,
+  TRACK_ELEM_25_DEG_UP_TO_LEFT_BANK,
+  TRACK_ELEM_25_DEG_UP_TO_RIGHT_BANK,
+  TRACK_ELEM_25_DEG_UP,
+  TRACK_ELEM_25_DEG_UP_TO_LEFT_BANKED_25_DEG_UP,
+  TRACK_ELEM_25_DEG_UP_TO_RIGHT_BANKED_25_DEG_UP,
+  TRACK_ELEM_25_DEG_UP_TO_60_DEG_UP,
+  TRACK_ELEM_LEFT_VERTICAL_LOOP,
+  TRACK_ELEM_RIGHT_VERTICAL_LOOP,
+};
+std::vector<track_type_t> statesForTrackElem25DegUpLeftBanked = {
+  TRACK_ELEM_25_DEG_UP_LEFT_BANKED,
+  TRACK_ELEM_LEFT_BANKED_25_DEG_UP_TO_25_DEG_UP,
+  TRACK_ELEM_LEFT_BANKED_25_DEG_UP_TO_LEFT_BANKED_FLAT,
+  TRACK_ELEM_LEFT_BANKED_25_DEG_UP_TO_FLAT,
+  TRACK_ELEM_LEFT_BANKED_QUARTER_TURN_5_TILE_25_DEG_UP,
+  TRACK_ELEM_LEFT_BANKED_QUARTER_TURN_3_TILE_25_DEG_UP,
+};
+std::vector<track_type_t> statesForTrackElem25DegUpRightBanked = {
+  TRACK_ELEM_25_DEG_UP_RIGHT_BANKED,
+  TRACK_ELEM_RIGHT_BANKED_25_DEG_UP_TO_25_DEG_UP,
+  TRACK_ELEM_RIGHT_BANKED_25_DEG_UP_TO_RIGHT_BANKED_FLAT,
+  TRACK_ELEM_RIGHT_BANKED_25_DEG_UP_TO_FLAT,
+  TRACK_ELEM_RIGHT_BANKED_QUARTER_TURN_5_TILE_25_DEG_UP,
+  TRACK_ELEM_RIGHT_BANKED_QUARTER_TURN_3_TILE_25_DEG_UP,
+};
+std::vector<track_type_t> statesForTrackElem60DegUp = {
+  TRACK_ELEM_60_DEG_UP_TO_25_DEG_UP,
+  TRACK_ELEM_60_DEG_UP,
+  TRACK_ELEM_RIGHT_QUARTER_TURN_1_TILE_60_DEG_UP,
+  TRACK_ELEM_LEFT_QUARTER_TURN_1_TILE_60_DEG_UP
+};
+std::vector<track_type_t> statesForTrackElem25DegDown = {
+  TRACK_ELEM_25_DEG_DOWN_TO_FLAT,
+  TRACK_ELEM_25_DEG_DOWN_TO_LEFT_BANK,
+  TRACK_ELEM_25_DEG_DOWN_TO_RIGHT_BANK,
+  TRACK_ELEM_25_DEG_DOWN,
+  TRACK_ELEM_25_DEG_DOWN_TO_LEFT_BANKED_25_DEG_DOWN,
+  TRACK_ELEM_25_DEG_DOWN_TO_RIGHT_BANKED_25_DEG_DOWN,
+  TRACK_ELEM_25_DEG_DOWN_TO_60_DEG_DOWN,
+};
+std::vector<track_type_t> statesForTrackElem25DegDownLeftBanked = {
+  TRACK_ELEM_25_DEG_DOWN_LEFT_BANKED,
+  TRACK_ELEM_LEFT_BANKED_25_DEG_DOWN_TO_25_DEG_DOWN,
+  TRACK_ELEM_LEFT_BANKED_25_DEG_DOWN_TO_LEFT_BANKED_FLAT,
+  TRACK_ELEM_LEFT_BANKED_25_DEG_DOWN_TO_FLAT,
+  TRACK_ELEM_LEFT_BANKED_QUARTER_TURN_5_TILE_25_DEG_DOWN,
+  TRACK_ELEM_LEFT_BANKED_QUARTER_TURN_3_TILE_25_DEG_DOWN,
+};
+std::vector<track_type_t> statesForTrackElem25DegDownRightBanked = {
+  TRACK_ELEM_25_DEG_DOWN_RIGHT_BANKED,
+  TRACK_ELEM_RIGHT_BANKED_25_DEG_DOWN_TO_25_DEG_DOWN,
+  TRACK_ELEM_RIGHT_BANKED_25_DEG_DOWN_TO_RIGHT_BANKED_FLAT,
+  TRACK_ELEM_RIGHT_BANKED_25_DEG_DOWN_TO_FLAT,
+  TRACK_ELEM_RIGHT_BANKED_QUARTER_TURN_5_TILE_25_DEG_DOWN,
+  TRACK_ELEM_RIGHT_BANKED_QUARTER_TURN_3_TILE_25_DEG_DOWN,
+};
+std::vector<track_type_t> statesForTrackElem60DegDown = {
+  TRACK_ELEM_60_DEG_DOWN_TO_25_DEG_DOWN,
+  TRACK_ELEM_60_DEG_DOWN,
+  TRACK_ELEM_RIGHT_QUARTER_TURN_1_TILE_60_DEG_DOWN,
+  TRACK_ELEM_LEFT_QUARTER_TURN_1_TILE_60_DEG_DOWN
+};
+
+std::map<track_type_t, std::vector<track_type_t>*> trackStateMachine = {
+  {TRACK_ELEM_FLAT, &statesForTrackElemFlat},
+  {TRACK_ELEM_FLAT_TO_LEFT_BANK, &statesForTrackElementLeftBank},
+  {TRACK_ELEM_FLAT_TO_RIGHT_BANK, &statesForTrackElementRightBank},
+  {TRACK_ELEM_FLAT_TO_25_DEG_UP, &statesForTrackElem25DegUp},
+  {TRACK_ELEM_FLAT_TO_LEFT_BANKED_25_DEG_UP,
+    &statesForTrackElem25DegUpLeftBanked},
+  {TRACK_ELEM_FLAT_TO_RIGHT_BANKED_25_DEG_UP,
+    &statesForTrackElem25DegUpRightBanked},
+  {TRACK_ELEM_FLAT_TO_25_DEG_DOWN, &statesForTrackElem25DegDown},
+  {TRACK_ELEM_FLAT_TO_LEFT_BANKED_25_DEG_DOWN,
+    &statesForTrackElem25DegDownLeftBanked},
+  {TRACK_ELEM_FLAT_TO_RIGHT_BANKED_25_DEG_DOWN,
+    &statesForTrackElem25DegDownRightBanked},
+  {TRACK_ELEM_LEFT_BANK, &statesForTrackElementLeftBank},
+  {TRACK_ELEM_LEFT_BANK_TO_FLAT, &statesForTrackElemFlat},
+  {TRACK_ELEM_LEFT_BANK_TO_25_DEG_UP, &statesForTrackElem25DegUp},
+  {TRACK_ELEM_LEFT_BANK_TO_25_DEG_DOWN, &statesForTrackElem25DegDown},
+  {TRACK_ELEM_LEFT_BANKED_FLAT_TO_LEFT_BANKED_25_DEG_UP,
+    &statesForTrackElem25DegUpLeftBanked},
+  {TRACK_ELEM_LEFT_BANKED_FLAT_TO_LEFT_BANKED_25_DEG_DOWN,
+    &statesForTrackElem25DegDownLeftBanked},
+  {TRACK_ELEM_25_DEG_UP_LEFT_BANKED, &statesForTrackElem25DegUpLeftBanked},
+  {TRACK_ELEM_BANKED_LEFT_QUARTER_TURN_5_TILES, &statesForTrackElementLeftBank},
+  {TRACK_ELEM_LEFT_QUARTER_TURN_3_TILES_BANK, &statesForTrackElementLeftBank},
+  {TRACK_ELEM_RIGHT_BANK, &statesForTrackElementRightBank},
+  {TRACK_ELEM_RIGHT_BANK_TO_FLAT, &statesForTrackElemFlat},
+  {TRACK_ELEM_RIGHT_BANK_TO_25_DEG_UP, &statesForTrackElem25DegUp},
+  {TRACK_ELEM_RIGHT_BANK_TO_25_DEG_DOWN, &statesForTrackElem25DegDown},
+  {TRACK_ELEM_RIGHT_BANKED_FLAT_TO_RIGHT_BANKED_25_DEG_UP,
+    &statesForTrackElem25DegUpRightBanked},
+  {TRACK_ELEM_RIGHT_BANKED_FLAT_TO_RIGHT_BANKED_25_DEG_DOWN,
+    &statesForTrackElem25DegDownRightBanked},
+  {TRACK_ELEM_25_DEG_UP_RIGHT_BANKED, &statesForTrackElem25DegUpRightBanked},
+  {TRACK_ELEM_BANKED_RIGHT_QUARTER_TURN_5_TILES,
+    &statesForTrackElementRightBank},
+  {TRACK_ELEM_RIGHT_QUARTER_TURN_3_TILES_BANK,
+    &statesForTrackElementRightBank},
+  {TRACK_ELEM_25_DEG_UP_TO_FLAT, &statesForTrackElemFlat},
+  {TRACK_ELEM_25_DEG_UP_TO_LEFT_BANK, &statesForTrackElementLeftBank},
+  {TRACK_ELEM_25_DEG_UP_TO_RIGHT_BANK, &statesForTrackElementRightBank},
+  {TRACK_ELEM_25_DEG_UP, &statesForTrackElem25DegUp},
+  {TRACK_ELEM_25_DEG_UP_TO_LEFT_BANKED_25_DEG_UP,
+    &statesForTrackElem25DegUpLeftBanked},
+  {TRACK_ELEM_25_DEG_UP_TO_RIGHT_BANKED_25_DEG_UP,
+    &statesForTrackElem25DegUpRightBanked},
+  {TRACK_ELEM_25_DEG_UP_TO_60_DEG_UP, &statesForTrackElem60DegUp},
+  {TRACK_ELEM_LEFT_BANKED_25_DEG_UP_TO_25_DEG_UP, &statesForTrackElem25DegUp},
+  {TRACK_ELEM_LEFT_BANKED_25_DEG_UP_TO_LEFT_BANKED_FLAT,
+    &statesForTrackElementLeftBank},
+  {TRACK_ELEM_LEFT_BANKED_25_DEG_UP_TO_FLAT, &statesForTrackElemFlat},
+  {TRACK_ELEM_LEFT_BANKED_QUARTER_TURN_5_TILE_25_DEG_UP,
+    &statesForTrackElem25DegUpLeftBanked},
+  {TRACK_ELEM_LEFT_BANKED_QUARTER_TURN_3_TILE_25_DEG_UP,
+    &statesForTrackElem25DegUpLeftBanked},
+  {TRACK_ELEM_RIGHT_BANKED_25_DEG_UP_TO_25_DEG_UP, &statesForTrackElem25DegUp},
+  {TRACK_ELEM_RIGHT_BANKED_25_DEG_UP_TO_RIGHT_BANKED_FLAT,
+    &statesForTrackElementRightBank},
+  {TRACK_ELEM_RIGHT_BANKED_25_DEG_UP_TO_FLAT, &statesForTrackElemFlat},
+  {TRACK_ELEM_RIGHT_BANKED_QUARTER_TURN_5_TILE_25_DEG_UP,
+    &statesForTrackElem25DegUpRightBanked},
+  {TRACK_ELEM_RIGHT_BANKED_QUARTER_TURN_3_TILE_25_DEG_UP,
+    &statesForTrackElem25DegUpRightBanked},
+  {TRACK_ELEM_60_DEG_UP_TO_25_DEG_UP, &statesForTrackElem25DegUp},
+  {TRACK_ELEM_60_DEG_UP, &statesForTrackElem60DegUp},
+  {TRACK_ELEM_RIGHT_QUARTER_TURN_1_TILE_60_DEG_UP, &statesForTrackElem60DegUp},
+  {TRACK_ELEM_LEFT_QUARTER_TURN_1_TILE_60_DEG_UP, &statesForTrackElem60DegUp},
+  {TRACK_ELEM_25_DEG_DOWN_TO_FLAT, &statesForTrackElemFlat},
+  {TRACK_ELEM_25_DEG_DOWN_TO_LEFT_BANK, &statesForTrackElementLeftBank},
+  {TRACK_ELEM_25_DEG_DOWN_TO_RIGHT_BANK, &statesForTrackElementRightBank},
+  {TRACK_ELEM_25_DEG_DOWN, &statesForTrackElem25DegDown},
+  {TRACK_ELEM_25_DEG_DOWN_TO_LEFT_BANKED_25_DEG_DOWN,
+    &statesForTrackElem25DegDownLeftBanked},
+  {TRACK_ELEM_25_DEG_DOWN_TO_RIGHT_BANKED_25_DEG_DOWN,
+    &statesForTrackElem25DegDownRightBanked},
+  {TRACK_ELEM_25_DEG_DOWN_TO_60_DEG_DOWN, &statesForTrackElem60DegDown},
+  {TRACK_ELEM_25_DEG_DOWN_LEFT_BANKED, &statesForTrackElem25DegDownLeftBanked},
+  {TRACK_ELEM_25_DEG_DOWN_RIGHT_BANKED,
+    &statesForTrackElem25DegDownRightBanked},
+  {TRACK_ELEM_LEFT_BANKED_25_DEG_DOWN_TO_25_DEG_DOWN,
+    &statesForTrackElem25DegDown},
+  {TRACK_ELEM_LEFT_BANKED_25_DEG_DOWN_TO_LEFT_BANKED_FLAT,
+    &statesForTrackElementLeftBank},
+  {TRACK_ELEM_LEFT_BANKED_25_DEG_DOWN_TO_FLAT, &statesForTrackElemFlat},
+  {TRACK_ELEM_LEFT_BANKED_QUARTER_TURN_5_TILE_25_DEG_DOWN,
+    &statesForTrackElem25DegDownLeftBanked},
+  {TRACK_ELEM_LEFT_BANKED_QUARTER_TURN_3_TILE_25_DEG_DOWN,
+    &statesForTrackElem25DegDownLeftBanked},
+  {TRACK_ELEM_RIGHT_BANKED_25_DEG_DOWN_TO_25_DEG_DOWN,
+    &statesForTrackElem25DegDown},
+  {TRACK_ELEM_RIGHT_BANKED_25_DEG_DOWN_TO_RIGHT_BANKED_FLAT,
+    &statesForTrackElementRightBank},
+  {TRACK_ELEM_RIGHT_BANKED_25_DEG_DOWN_TO_FLAT, &statesForTrackElemFlat},
+  {TRACK_ELEM_RIGHT_BANKED_QUARTER_TURN_5_TILE_25_DEG_DOWN,
+    &statesForTrackElem25DegDownRightBanked},
+  {TRACK_ELEM_RIGHT_BANKED_QUARTER_TURN_3_TILE_25_DEG_DOWN,
+    &statesForTrackElem25DegDownRightBanked},
+  {TRACK_ELEM_60_DEG_DOWN_TO_25_DEG_DOWN, &statesForTrackElem25DegDown},
+  {TRACK_ELEM_60_DEG_DOWN, &statesForTrackElem60DegDown},
+  {TRACK_ELEM_RIGHT_QUARTER_TURN_1_TILE_60_DEG_DOWN,
+    &statesForTrackElem60DegDown},
+  {TRACK_ELEM_LEFT_QUARTER_TURN_1_TILE_60_DEG_DOWN,
+    &statesForTrackElem60DegDown},
+  {TRACK_ELEM_LEFT_VERTICAL_LOOP, &statesForTrackElem25DegDown},
+  {TRACK_ELEM_RIGHT_VERTICAL_LOOP, &statesForTrackElem25DegDown}
+};
+
+TrackPiece trackPieceForFlat = {.shape={
+    {.coord={0, 0, 0}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, 1}, .cell={1, 1, 1, 1}}}, .ptr={1, 0, 0}};
+TrackPiece trackPieceForFlatTo25DegUp = {.shape={
+    {.coord={0, 0, 0}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, 1}, .cell={1, 1, 1, 1}}}, .ptr={1, 0, 1}};
+TrackPiece trackPieceFor25DegUp = {.shape={
+    {.coord={0, 0, -1}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, 0}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, 1}, .cell={1, 1, 1, 1}}}, .ptr={1, 0, 1}};
+TrackPiece trackPieceFor25DegUpToFlat = {.shape={
+    {.coord={0, 0, -1}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, 0}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, 1}, .cell={1, 1, 1, 1}}}, .ptr={1, 0, 0}};
+TrackPiece trackPieceFor25DegUpTo60DegUp = {.shape={
+    {.coord={0, 0, -1}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, 0}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, 1}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, 2}, .cell={1, 1, 1, 1}}}, .ptr={1, 0, 2}};
+TrackPiece trackPieceFor60DegUp = {.shape={
+    {.coord={0, 0, -1}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, 0}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, 1}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, 2}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, 3}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, 4}, .cell={1, 1, 1, 1}}}, .ptr={1, 0, 4}};
+TrackPiece trackPieceFor25DegDown = {.shape={
+    {.coord={0, 0, -1}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, 0}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, 1}, .cell={1, 1, 1, 1}}}, .ptr={1, 0, -1}};
+TrackPiece trackPieceFor25DegDownToFloat = {.shape={
+    {.coord={0, 0, -1}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, 0}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, 1}, .cell={1, 1, 1, 1}}}, .ptr={1, 0, 0}};
+TrackPiece trackPieceFor25DegDownTo60DegDown = {.shape={
+    {.coord={0, 0, -2}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, -1}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, 0}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, 1}, .cell={1, 1, 1, 1}}}, .ptr={1, 0, -2}};
+TrackPiece trackPieceFor60DegDown = {.shape={
+    {.coord={0, 0, -4}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, -3}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, -2}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, -1}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, 0}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, 1}, .cell={1, 1, 1, 1}}}, .ptr={1, 0, -4}};
+TrackPiece trackPieceForQuarterTurn5Tiles = {.shape={
+  {.coord={0, 0, 0}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 1, 0}, .cell={0, 0, 1, 0}}, 
+    {.coord={1, 0, 0}, .cell={1, 1, 0, 1}}, 
+    {.coord={1, 1, 0}, .cell={1, 0, 1, 1}}, 
+    {.coord={1, 2, 0}, .cell={0, 0, 1, 0}}, 
+    {.coord={2, 1, 0}, .cell={1, 1, 0, 1}}, 
+    {.coord={2, 2, 0}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, 1}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 1, 1}, .cell={0, 0, 1, 0}}, 
+    {.coord={1, 0, 1}, .cell={1, 1, 0, 1}}, 
+    {.coord={1, 1, 1}, .cell={1, 0, 1, 1}}, 
+    {.coord={1, 2, 1}, .cell={0, 0, 1, 0}}, 
+    {.coord={2, 1, 1}, .cell={1, 1, 0, 1}}, 
+    {.coord={2, 2, 1}, .cell={1, 1, 1, 1}}}, .ptr={2, 3, 0}};
+TrackPiece trackPieceForQuarterTurn5Tiles25DegUp = {.shape={
+    {.coord={0, 0, -1}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, 0}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, 1}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 1, 0}, .cell={0, 0, 1, 0}}, 
+    {.coord={0, 1, 1}, .cell={0, 0, 1, 0}}, 
+    {.coord={1, 0, 0}, .cell={1, 1, 0, 1}}, 
+    {.coord={1, 0, 1}, .cell={1, 1, 0, 1}}, 
+    {.coord={1, 0, 2}, .cell={1, 1, 0, 1}}, 
+    {.coord={1, 1, 1}, .cell={1, 0, 1, 1}}, 
+    {.coord={1, 1, 2}, .cell={1, 0, 1, 1}}, 
+    {.coord={1, 1, 3}, .cell={1, 0, 1, 1}}, 
+    {.coord={2, 1, 1}, .cell={1, 1, 0, 1}}, 
+    {.coord={2, 1, 2}, .cell={1, 1, 0, 1}}, 
+    {.coord={2, 1, 3}, .cell={1, 1, 0, 1}}, 
+    {.coord={1, 2, 2}, .cell={0, 0, 1, 0}}, 
+    {.coord={1, 2, 3}, .cell={0, 0, 1, 0}}, 
+    {.coord={2, 2, 2}, .cell={1, 1, 1, 1}}, 
+    {.coord={2, 2, 3}, .cell={1, 1, 1, 1}}, 
+    {.coord={2, 2, 4}, .cell={1, 1, 1, 1}}}, .ptr={2, 3, 4}};
+TrackPiece trackPieceForQuarterTurn5Tiles25DegDown = {.shape={
+    {.coord={0, 0, -1}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, 0}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, 1}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 1, 0}, .cell={0, 0, 1, 0}}, 
+    {.coord={0, 1, -1}, .cell={0, 0, 1, 0}}, 
+    {.coord={1, 0, 1}, .cell={1, 1, 0, 1}}, 
+    {.coord={1, 0, 0}, .cell={1, 1, 0, 1}}, 
+    {.coord={1, 0, -1}, .cell={1, 1, 0, 1}}, 
+    {.coord={1, 0, -2}, .cell={1, 1, 0, 1}}, 
+    {.coord={1, 1, 0}, .cell={1, 0, 1, 1}}, 
+    {.coord={1, 1, -1}, .cell={1, 0, 1, 1}}, 
+    {.coord={1, 1, -2}, .cell={1, 0, 1, 1}}, 
+    {.coord={1, 1, -3}, .cell={1, 0, 1, 1}}, 
+    {.coord={2, 1, -1}, .cell={1, 1, 0, 1}}, 
+    {.coord={2, 1, -2}, .cell={1, 1, 0, 1}}, 
+    {.coord={2, 1, -3}, .cell={1, 1, 0, 1}}, 
+    {.coord={1, 2, -1}, .cell={0, 0, 1, 0}}, 
+    {.coord={1, 2, -2}, .cell={0, 0, 1, 0}}, 
+    {.coord={1, 2, -3}, .cell={0, 0, 1, 0}}, 
+    {.coord={2, 2, -2}, .cell={1, 1, 1, 1}}, 
+    {.coord={2, 2, -3}, .cell={1, 1, 1, 1}}, 
+    {.coord={2, 2, -4}, .cell={1, 1, 1, 1}}}, .ptr={2, 3, -4}};
+TrackPiece trackPieceForQuarterTurn3Tiles = {.shape={
+    {.coord={0, 0, 0}, .cell={1, 1, 0, 1}}, 
+    {.coord={0, 1, 0}, .cell={0, 0, 1, 0}}, 
+    {.coord={1, 0, 0}, .cell={0, 1, 0, 0}}, 
+    {.coord={1, 1, 0}, .cell={1, 1, 0, 1}}, 
+    {.coord={0, 0, 1}, .cell={1, 1, 0, 1}}, 
+    {.coord={0, 1, 1}, .cell={0, 0, 1, 0}}, 
+    {.coord={1, 0, 1}, .cell={0, 1, 0, 0}}, 
+    {.coord={1, 1, 1}, .cell={1, 1, 0, 1}}}, .ptr={1, 2, 0}};
+TrackPiece trackPieceForQuarterTurn3Tiles25DegUp = {.shape={
+    {.coord={0, 0, -1}, .cell={1, 1, 0, 1}}, 
+    {.coord={0, 0, 0}, .cell={1, 1, 0, 1}}, 
+    {.coord={0, 0, 1}, .cell={1, 1, 0, 1}}, 
+    {.coord={0, 1, 0}, .cell={0, 0, 1, 0}}, 
+    {.coord={0, 1, 1}, .cell={0, 0, 1, 0}}, 
+    {.coord={1, 0, 0}, .cell={0, 1, 0, 0}}, 
+    {.coord={1, 0, 1}, .cell={0, 1, 0, 0}}, 
+    {.coord={1, 1, 0}, .cell={1, 1, 0, 1}}, 
+    {.coord={1, 1, 1}, .cell={1, 1, 0, 1}}, 
+    {.coord={1, 1, 2}, .cell={1, 1, 0, 1}}}, .ptr={1, 2, 2}};
+TrackPiece trackPieceForQuarterTurn3Tiles25DegDown = {.shape={
+    {.coord={0, 0, -1}, .cell={1, 1, 0, 1}}, 
+    {.coord={0, 0, 0}, .cell={1, 1, 0, 1}}, 
+    {.coord={0, 0, 1}, .cell={1, 1, 0, 1}}, 
+    {.coord={0, 1, 0}, .cell={0, 0, 1, 0}}, 
+    {.coord={0, 1, -1}, .cell={0, 0, 1, 0}}, 
+    {.coord={1, 0, 0}, .cell={0, 1, 0, 0}}, 
+    {.coord={1, 0, -1}, .cell={0, 1, 0, 0}}, 
+    {.coord={1, 1, 0}, .cell={1, 1, 0, 1}}, 
+    {.coord={1, 1, -1}, .cell={1, 1, 0, 1}}, 
+    {.coord={1, 1, -2}, .cell={1, 1, 0, 1}}}, .ptr={1, 2, -2}};
+TrackPiece trackPieceForQuarterTurn3Tiles60DegUp = {.shape={
+    {.coord={0, 0, -1}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, 0}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, 1}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, 2}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, 3}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, 4}, .cell={1, 1, 1, 1}}}, .ptr={0, 1, 4}};
+TrackPiece trackPieceForQuarterTurn3Tiles60DegDown = {.shape={
+    {.coord={0, 0, 1}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, 0}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, -1}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, -2}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, -3}, .cell={1, 1, 1, 1}}, 
+    {.coord={0, 0, -4}, .cell={1, 1, 1, 1}}}, .ptr={0, 1, -4}};
+TrackPiece trackPieceForRightVerticalLoop = {.shape={
+    {.coord={0, 0, -1}, .cell={1, 1, 1, 1}},
+    {.coord={0, 0, 0}, .cell={1, 1, 1, 1}},
+    {.coord={0, 0, 1}, .cell={1, 1, 1, 1}},
+    {.coord={1, 0, 0}, .cell={1, 1, 1, 1}},
+    {.coord={1, 0, 1}, .cell={1, 1, 1, 1}},
+    {.coord={1, 0, 2}, .cell={1, 1, 1, 1}},
+    {.coord={1, 0, 7}, .cell={0, 1, 0, 1}},
+    {.coord={1, 0, 8}, .cell={0, 1, 0, 1}},
+    {.coord={1, 0, 9}, .cell={0, 1, 0, 1}},
+    {.coord={2, 0, 1}, .cell={0, 1, 0, 0}},
+    {.coord={2, 0, 2}, .cell={0, 1, 0, 0}},
+    {.coord={2, 0, 3}, .cell={0, 1, 0, 0}},
+    {.coord={2, 0, 4}, .cell={0, 1, 0, 0}},
+    {.coord={2, 0, 5}, .cell={0, 1, 0, 0}},
+    {.coord={2, 0, 6}, .cell={0, 1, 0, 0}},
+    {.coord={2, 0, 7}, .cell={0, 1, 0, 0}},
+    {.coord={2, 0, 8}, .cell={0, 1, 0, 0}},
+    {.coord={1, 1, -1}, .cell={1, 1, 1, 1}},
+    {.coord={1, 1, 0}, .cell={1, 1, 1, 1}},
+    {.coord={1, 1, 1}, .cell={1, 1, 1, 1}},
+    {.coord={0, 1, 0}, .cell={1, 1, 1, 1}},
+    {.coord={0, 1, 1}, .cell={1, 1, 1, 1}},
+    {.coord={0, 1, 2}, .cell={1, 1, 1, 1}},
+    {.coord={0, 1, 7}, .cell={1, 0, 1, 0}},
+    {.coord={0, 1, 8}, .cell={1, 0, 1, 0}},
+    {.coord={0, 1, 9}, .cell={1, 0, 1, 0}},
+    {.coord={-1, 1, 1}, .cell={0, 0, 1, 0}},
+    {.coord={-1, 1, 2}, .cell={0, 0, 1, 0}},
+    {.coord={-1, 1, 3}, .cell={0, 0, 1, 0}},
+    {.coord={-1, 1, 4}, .cell={0, 0, 1, 0}},
+    {.coord={-1, 1, 5}, .cell={0, 0, 1, 0}},
+    {.coord={-1, 1, 6}, .cell={0, 0, 1, 0}},
+    {.coord={-1, 1, 7}, .cell={0, 0, 1, 0}},
+    {.coord={-1, 1, 8}, .cell={0, 0, 1, 0}}}, .ptr={2, 1, -1}};
+
+// Makes copies because mirroring happens later.
+std::map<track_type_t, TrackPiece> trackData = {
+  {TRACK_ELEM_BEGIN_STATION, trackPieceForFlat},
+  {TRACK_ELEM_MIDDLE_STATION, trackPieceForFlat},
+  {TRACK_ELEM_END_STATION, trackPieceForFlat},
+  {TRACK_ELEM_FLAT, trackPieceForFlat},
+  {TRACK_ELEM_FLAT_TO_RIGHT_BANK, trackPieceForFlat},
+  {TRACK_ELEM_FLAT_TO_25_DEG_UP, trackPieceForFlatTo25DegUp},
+  {TRACK_ELEM_FLAT_TO_RIGHT_BANKED_25_DEG_UP, trackPieceForFlatTo25DegUp},
+  {TRACK_ELEM_FLAT_TO_25_DEG_DOWN, trackPieceFor25DegDown},
+  {TRACK_ELEM_FLAT_TO_RIGHT_BANKED_25_DEG_DOWN, trackPieceFor25DegDown},
+  {TRACK_ELEM_RIGHT_BANKED_FLAT_TO_RIGHT_BANKED_25_DEG_UP,
+    trackPieceForFlatTo25DegUp},
+  {TRACK_ELEM_RIGHT_BANKED_FLAT_TO_RIGHT_BANKED_25_DEG_DOWN,
+    trackPieceFor25DegDown},
+  {TRACK_ELEM_RIGHT_BANK, trackPieceForFlat},
+  {TRACK_ELEM_RIGHT_BANK_TO_FLAT, trackPieceForFlat},
+  {TRACK_ELEM_RIGHT_BANK_TO_25_DEG_UP, trackPieceForFlatTo25DegUp},
+  {TRACK_ELEM_RIGHT_BANK_TO_25_DEG_DOWN, trackPieceFor25DegDown},
+  {TRACK_ELEM_25_DEG_UP_RIGHT_BANKED, trackPieceFor25DegUp},
+  {TRACK_ELEM_BANKED_RIGHT_QUARTER_TURN_5_TILES,
+    trackPieceForQuarterTurn5Tiles},
+  {TRACK_ELEM_RIGHT_QUARTER_TURN_3_TILES_BANK, trackPieceForQuarterTurn3Tiles},
+  {TRACK_ELEM_25_DEG_UP_TO_FLAT, trackPieceFor25DegUpToFlat},
+  {TRACK_ELEM_25_DEG_UP_TO_RIGHT_BANK, trackPieceFor25DegUpToFlat},
+  {TRACK_ELEM_25_DEG_UP, trackPieceFor25DegUp},
+  {TRACK_ELEM_25_DEG_UP_TO_RIGHT_BANKED_25_DEG_UP, trackPieceFor25DegUp},
+  {TRACK_ELEM_25_DEG_UP_TO_60_DEG_UP, trackPieceFor25DegUpTo60DegUp},
+  {TRACK_ELEM_RIGHT_BANKED_25_DEG_UP_TO_25_DEG_UP, trackPieceFor25DegUp},
+  {TRACK_ELEM_RIGHT_BANKED_25_DEG_UP_TO_RIGHT_BANKED_FLAT,
+    trackPieceFor25DegUpToFlat},
+  {TRACK_ELEM_RIGHT_BANKED_25_DEG_UP_TO_FLAT, trackPieceFor25DegUpToFlat},
+  {TRACK_ELEM_RIGHT_BANKED_QUARTER_TURN_5_TILE_25_DEG_UP,
+    trackPieceForQuarterTurn5Tiles25DegUp},
+  {TRACK_ELEM_RIGHT_BANKED_QUARTER_TURN_3_TILE_25_DEG_UP,
+    trackPieceForQuarterTurn3Tiles25DegUp},
+  {TRACK_ELEM_60_DEG_UP_TO_25_DEG_UP, trackPieceFor25DegUpTo60DegUp},
+  {TRACK_ELEM_60_DEG_UP, trackPieceFor60DegUp},
+  {TRACK_ELEM_RIGHT_QUARTER_TURN_1_TILE_60_DEG_UP,
+    trackPieceForQuarterTurn3Tiles60DegUp},
+  {TRACK_ELEM_25_DEG_DOWN_TO_FLAT, trackPieceFor25DegDownToFloat},
+  {TRACK_ELEM_25_DEG_DOWN_TO_RIGHT_BANK, trackPieceFor25DegDownToFloat},
+  {TRACK_ELEM_25_DEG_DOWN, trackPieceFor25DegDown},
+  {TRACK_ELEM_25_DEG_DOWN_TO_RIGHT_BANKED_25_DEG_DOWN, trackPieceFor25DegDown},
+  {TRACK_ELEM_25_DEG_DOWN_TO_60_DEG_DOWN, trackPieceFor25DegDownTo60DegDown},
+  {TRACK_ELEM_25_DEG_DOWN_RIGHT_BANKED, trackPieceFor25DegDown},
+  {TRACK_ELEM_RIGHT_BANKED_25_DEG_DOWN_TO_25_DEG_DOWN, trackPieceFor25DegDown},
+  {TRACK_ELEM_RIGHT_BANKED_25_DEG_DOWN_TO_RIGHT_BANKED_FLAT,
+    trackPieceFor25DegDownToFloat},
+  {TRACK_ELEM_RIGHT_BANKED_25_DEG_DOWN_TO_FLAT, trackPieceFor25DegDownToFloat},
+  {TRACK_ELEM_RIGHT_BANKED_QUARTER_TURN_5_TILE_25_DEG_DOWN,
+    trackPieceForQuarterTurn5Tiles25DegDown},
+  {TRACK_ELEM_RIGHT_BANKED_QUARTER_TURN_3_TILE_25_DEG_DOWN,
+    trackPieceForQuarterTurn3Tiles25DegDown},
+  {TRACK_ELEM_60_DEG_DOWN_TO_25_DEG_DOWN, trackPieceFor25DegDownTo60DegDown},
+  {TRACK_ELEM_60_DEG_DOWN, trackPieceFor60DegDown},
+  {TRACK_ELEM_RIGHT_QUARTER_TURN_1_TILE_60_DEG_DOWN,
+    trackPieceForQuarterTurn3Tiles60DegDown},
+  {TRACK_ELEM_RIGHT_VERTICAL_LOOP, trackPieceForRightVerticalLoop},
+  // Only used to begin coaster. All other turns are banked.
+  {TRACK_ELEM_RIGHT_QUARTER_TURN_3_TILES, trackPieceForQuarterTurn3Tiles},
+};
+
+// Left pieces are generated by mirroring their right counterpart.
+std::map<track_type_t, track_type_t> mirrorMap = {
+  {TRACK_ELEM_FLAT_TO_LEFT_BANK, TRACK_ELEM_FLAT_TO_RIGHT_BANK},
+  {TRACK_ELEM_FLAT_TO_LEFT_BANKED_25_DEG_UP,
+    TRACK_ELEM_FLAT_TO_RIGHT_BANKED_25_DEG_UP},
+  {TRACK_ELEM_FLAT_TO_LEFT_BANKED_25_DEG_DOWN,
+    TRACK_ELEM_FLAT_TO_RIGHT_BANKED_25_DEG_DOWN},
+  {TRACK_ELEM_LEFT_BANK, TRACK_ELEM_RIGHT_BANK},
+  {TRACK_ELEM_LEFT_BANK_TO_FLAT, TRACK_ELEM_RIGHT_BANK_TO_FLAT},
+  {TRACK_ELEM_LEFT_BANK_TO_25_DEG_UP, TRACK_ELEM_RIGHT_BANK_TO_25_DEG_UP},
+  {TRACK_ELEM_LEFT_BANK_TO_25_DEG_DOWN, TRACK_ELEM_RIGHT_BANK_TO_25_DEG_DOWN},
+  {TRACK_ELEM_LEFT_BANKED_FLAT_TO_LEFT_BANKED_25_DEG_UP,
+    TRACK_ELEM_RIGHT_BANKED_FLAT_TO_RIGHT_BANKED_25_DEG_UP},
+  {TRACK_ELEM_LEFT_BANKED_FLAT_TO_LEFT_BANKED_25_DEG_DOWN,
+    TRACK_ELEM_RIGHT_BANKED_FLAT_TO_RIGHT_BANKED_25_DEG_DOWN},
+  {TRACK_ELEM_25_DEG_UP_LEFT_BANKED, TRACK_ELEM_25_DEG_UP_RIGHT_BANKED},
+  {TRACK_ELEM_BANKED_LEFT_QUARTER_TURN_5_TILES,
+    TRACK_ELEM_BANKED_RIGHT_QUARTER_TURN_5_TILES},
+  {TRACK_ELEM_LEFT_QUARTER_TURN_3_TILES_BANK,
+    TRACK_ELEM_RIGHT_QUARTER_TURN_3_TILES_BANK},
+  {TRACK_ELEM_25_DEG_UP_TO_LEFT_BANK, TRACK_ELEM_25_DEG_UP_TO_RIGHT_BANK},
+  {TRACK_ELEM_25_DEG_UP_TO_LEFT_BANKED_25_DEG_UP,
+    TRACK_ELEM_25_DEG_UP_TO_RIGHT_BANKED_25_DEG_UP},
+  {TRACK_ELEM_LEFT_BANKED_25_DEG_UP_TO_25_DEG_UP,
+    TRACK_ELEM_RIGHT_BANKED_25_DEG_UP_TO_25_DEG_UP},
+  {TRACK_ELEM_LEFT_BANKED_25_DEG_UP_TO_LEFT_BANKED_FLAT,
+    TRACK_ELEM_RIGHT_BANKED_25_DEG_UP_TO_RIGHT_BANKED_FLAT},
+  {TRACK_ELEM_LEFT_BANKED_25_DEG_UP_TO_FLAT,
+    TRACK_ELEM_RIGHT_BANKED_25_DEG_UP_TO_FLAT},
+  {TRACK_ELEM_LEFT_BANKED_QUARTER_TURN_5_TILE_25_DEG_UP,
+    TRACK_ELEM_RIGHT_BANKED_QUARTER_TURN_5_TILE_25_DEG_UP},
+  {TRACK_ELEM_LEFT_BANKED_QUARTER_TURN_3_TILE_25_DEG_UP,
+    TRACK_ELEM_RIGHT_BANKED_QUARTER_TURN_3_TILE_25_DEG_UP},
+  {TRACK_ELEM_LEFT_QUARTER_TURN_1_TILE_60_DEG_UP,
+    TRACK_ELEM_RIGHT_QUARTER_TURN_1_TILE_60_DEG_UP},
+  {TRACK_ELEM_25_DEG_DOWN_TO_LEFT_BANK, TRACK_ELEM_25_DEG_DOWN_TO_RIGHT_BANK},
+  {TRACK_ELEM_25_DEG_DOWN_TO_LEFT_BANKED_25_DEG_DOWN,
+    TRACK_ELEM_25_DEG_DOWN_TO_RIGHT_BANKED_25_DEG_DOWN},
+  {TRACK_ELEM_25_DEG_DOWN_LEFT_BANKED, TRACK_ELEM_25_DEG_DOWN_RIGHT_BANKED},
+  {TRACK_ELEM_LEFT_BANKED_25_DEG_DOWN_TO_25_DEG_DOWN,
+    TRACK_ELEM_RIGHT_BANKED_25_DEG_DOWN_TO_25_DEG_DOWN},
+  {TRACK_ELEM_LEFT_BANKED_25_DEG_DOWN_TO_LEFT_BANKED_FLAT,
+    TRACK_ELEM_RIGHT_BANKED_25_DEG_DOWN_TO_RIGHT_BANKED_FLAT},
+  {TRACK_ELEM_LEFT_BANKED_25_DEG_DOWN_TO_FLAT,
+    TRACK_ELEM_RIGHT_BANKED_25_DEG_DOWN_TO_FLAT},
+  {TRACK_ELEM_LEFT_BANKED_QUARTER_TURN_5_TILE_25_DEG_DOWN,
+    TRACK_ELEM_RIGHT_BANKED_QUARTER_TURN_5_TILE_25_DEG_DOWN},
+  {TRACK_ELEM_LEFT_BANKED_QUARTER_TURN_3_TILE_25_DEG_DOWN,
+    TRACK_ELEM_RIGHT_BANKED_QUARTER_TURN_3_TILE_25_DEG_DOWN},
+  {TRACK_ELEM_LEFT_QUARTER_TURN_1_TILE_60_DEG_DOWN,
+    TRACK_ELEM_RIGHT_QUARTER_TURN_1_TILE_60_DEG_DOWN},
+  {TRACK_ELEM_LEFT_VERTICAL_LOOP, TRACK_ELEM_RIGHT_VERTICAL_LOOP},
+  {TRACK_ELEM_LEFT_QUARTER_TURN_3_TILES,
+    TRACK_ELEM_RIGHT_QUARTER_TURN_3_TILES},
+};
+
+std::map<std::pair<track_type_t, DirectionType>, TrackPiece> trackDataRot;
+PieceTables tables;
+
+// The minimum number of pieces needed to get from a state to the end,
+// ignoring occupancy. A state is a position, a direction and the successor
+// list of the last piece. See ClosingDistance(). Points to
+// `computedDistances`, or into the table cache.
+const uint8_t *closingDistances = nullptr;
+size_t numClosingDistances = 0;
+std::vector<uint8_t> computedDistances;
+
+// Random keys of the Zobrist hash of the grid, one per bit of every word.
+std::vector<uint64_t> occupancyKeys;
+
+// Every table cache the process mapped, by path, with its size. They stay
+// mapped, so switching back to a grid size doesn't map its file again.
+std::map<std::string, std::pair<const char *, uint64_t>> mappedTableCaches;
+
+// Built by BuildConnectors() on first use, into `builtConnectors` and
+// `builtSteps`, or mapped from the table cache.
+ConnectorLibrary connectorLibrary = {};
+std::vector<Connector> builtConnectors;
+std::vector<uint8_t> builtSteps;
+
+// The grid size closingDistances and occupancyKeys were computed for.
+Coord preparedGrid = {0, 0, 0};
+
+// The station starts at kStartCoord facing east. To finish, the generator
+// must land on kEndCoord (the tile before the station) facing east.
+constexpr Coord kStartCoord = {0, 4, 0};
+constexpr Coord kEndCoord = {0, 3, 0};
+
+bool operator==(const Coord& a, const Coord& b);
+Coord AddCoords(const Coord& c0, const Coord& c1);
+template <typename Grid>
+bool OutOfBounds(const Coord& coord);
+Coord MirrorCoord(const Coord& coord);
+TrackCell MirrorTrackCell(const TrackCell& tc);
+TrackPiece MirrorTrackPiece(const TrackPiece& tp);
+Coord RotateCoord(const Coord& coord);
+TrackCell RotateTrackCell(const TrackCell& tc);
+TrackPiece RotateTrackPiece(const TrackPiece& tp);
+uint64_t CellBits(const Cell& cell);
+CompiledPiece CompileTrackPiece(const TrackPiece& tp);
+void CompileTables();
+template <typename Grid>
+void PrepareGrid();
+template <typename Grid>
+void ComputeOccupancyKeys();
+void HashBytes(uint64_t *hash, const void *data, size_t size);
+void HashInt(uint64_t *hash, int64_t value);
+template <typename Grid>
+uint64_t TableCacheKey();
+bool ValidTables(const PieceTables& cached);
+bool ValidConnectors(
+  const PieceTables& cached,
+  const ConnectorLibrary& library);
+template <typename Grid>
+bool LoadTableCache(const std::string& path, uint64_t key);
+bool SaveTableCache(const std::string& path, uint64_t key);
+template <typename Grid>
+void PrepareTables(const GeneratorOptions& options);
+void CompileTrackWeights(
+  const GeneratorOptions& options,
+  TrackWeights *weights);
+void SeedRandom(Random *random, uint64_t seed);
+uint64_t NextRandom(Random *random);
+uint32_t RandomBelow(Random *random, uint32_t n);
+float RandomUnit(Random *random);
+template <typename Grid>
+int DistanceIndex(const Coord& ptr, int dir, int list);
+template <typename Grid>
+uint8_t ClosingDistance(const Coord& ptr, int dir, int list);
+template <typename Grid>
+bool PieceInBounds(const Coord& ptr, int dir, piece_id_t piece);
+template <typename Grid>
+void ComputeClosingDistances();
+template <typename Grid>
+int RowIndex(int y, int z);
+uint64_t OccupancyHash(int index, uint64_t bits);
+void SetOwners(Space *space, int index, uint64_t bits, int owner);
+int ShallowestOwner(const Space& space, int index, uint64_t bits);
+template <typename Grid>
+void WriteSpace(Space *space, const Coord& ptr, Cell newCells);
+void UndoSpace(Space *space, size_t undoOffset);
+template <typename Grid>
+bool AddTrackToSpace(
+  Space *space,
+  const Coord& ptr,
+  DirectionType dir, 
+  const TrackDesignTrackElement& track,
+  int owner,
+  size_t *blocker);
+template <typename Grid>
+bool AddTrackToStack(
+  Search *search,
+  const TrackDesignTrackElement& track);
+int SuccessorIndex(int list, track_type_t type);
+template <typename Grid>
+int ChooseClosingTrack(Search *search, int list, uint16_t available);
+int PickWeightedTrack(Search *search, int list, uint16_t available);
+template <typename Grid>
+bool ChooseTrack(
+  Search *search,
+  uint16_t *failedTracks,
+  piece_id_t lastPiece,
+  size_t rootDepth);
+template <typename Grid>
+uint64_t StateKey(
+  uint64_t hash,
+  const Coord& ptr,
+  DirectionType dir,
+  int list,
+  size_t size);
+uint64_t MixKey(uint64_t key);
+float NextEnergy(
+  const Search& search,
+  const TrackDesignTrackElement& track,
+  int rise);
+RideFeatures AddFeatures(const RideFeatures& features, piece_id_t piece);
+RideRatings EstimateRatings(const RideFeatures& features);
+void CountRejection(Search *search, track_type_t type, RejectReason reason);
+bool IsDeadState(Search *search, uint64_t key, float energy);
+void AddDeadState(Search *search, uint64_t key, float energy);
+void ClearConflicts(Search *search, size_t depth);
+void AddConflict(Search *search, size_t depth);
+void Backtrack(Search *search, size_t rootDepth);
+template <typename Grid>
+void ResetSearch(Search *search);
+template <typename Grid>
+bool StartAttempt(Search *search, Portfolio *portfolio);
+int Luby(int i);
+int AttemptBudget(const GeneratorOptions& options, int restart);
+void RewindToCheckpoint(Search *search, size_t rootDepth);
+template <typename Grid>
+void GrowBackwardTracks(
+  Search *search,
+  const Coord& ptr,
+  DirectionType dir,
+  std::vector<piece_id_t> *suffix,
+  BackwardTracks *backwardTracks);
+template <typename Grid>
+void BuildBackwardTracks(Search *search, BackwardTracks *backwardTracks);
+template <typename Grid>
+bool JoinBackwardTrack(Search *search, const BackwardTracks& backwardTracks);
+uint32_t ConnectorKey(
+  int list,
+  int dirIn,
+  const Coord& offset,
+  int dirOut);
+bool AddConnectorPiece(
+  Space *space,
+  const Coord& ptr,
+  DirectionType dir,
+  piece_id_t piece);
+void GrowConnectors(
+  Space *space,
+  uint32_t key,
+  const Coord& ptr,
+  DirectionType dir,
+  int list,
+  std::vector<uint8_t> *steps);
+void BuildConnectors();
+template <typename Grid>
+bool JoinConnector(Search *search);
+template <typename Grid>
+SearchResult RunSearch(
+  Search *search,
+  size_t rootDepth,
+  int budget,
+  Portfolio *portfolio,
+  WorkPool *pool);
+void ClaimResult(Search *search, Portfolio *portfolio);
+bool PastDeadline(Portfolio *portfolio);
+template <typename Grid>
+void RunPortfolioWorker(Search *search, Portfolio *portfolio);
+void DonateWork(Search *search, size_t rootDepth, WorkPool *pool);
+bool TakeWork(WorkPool *pool, Portfolio *portfolio, WorkItem *item);
+void StopPool(WorkPool *pool);
+template <typename Grid>
+void RunStealingWorker(
+  Search *search,
+  Portfolio *portfolio,
+  WorkPool *pool,
+  bool first);
+template <typename Grid>
+float ClosingScore(const Search& search);
+float ExcitementScore(const Search& search);
+float SpeedScore(const Search& search);
+void PopTrack(Search *search);
+uint64_t BeamKey(const GeneratorInfo& info);
+size_t BeamWidthLimit(const GeneratorOptions& options);
+template <typename Grid>
+bool ReplayBeamNode(
+  Search *search,
+  const std::vector<BeamNode>& nodes,
+  uint32_t node,
+  size_t initialSize,
+  std::vector<track_type_t> *types);
+template <typename Grid>
+bool RunBeamSearch(Search *search, Portfolio *portfolio, size_t width);
+template <typename Grid>
+void RunBeamWorker(Search *search, Portfolio *portfolio);
+float InversionScore(const Search& search);
+template <typename Grid>
+float FootprintScore(const Search& search);
+void OfferResult(Search *search, Portfolio *portfolio, float reward);
+bool SelectMctsPath(
+  MctsTree *tree,
+  std::vector<uint32_t> *nodes,
+  std::vector<track_type_t> *types);
+template <typename Grid>
+bool ExpandMctsNode(
+  Search *search,
+  MctsTree *tree,
+  std::vector<uint32_t> *nodes);
+void MarkMctsDead(MctsTree *tree, uint32_t node);
+void Backpropagate(
+  MctsTree *tree,
+  const std::vector<uint32_t>& nodes,
+  float reward);
+template <typename Grid>
+void RunMctsWorker(Search *search, Portfolio *portfolio, MctsTree *tree);
+void AddStats(GeneratorStats *total, const GeneratorStats& stats);
+template <typename Grid>
+GeneratorResult GenerateOnGrid(
+  const GeneratorOptions& options,
+  GeneratorStats *stats);
+
+/*
+ * Definitions
+ */
+
+DirectionType TurnLeft(DirectionType dir) {
+  switch (dir) {
+    case kNorth:
+      return kWest;
+    case kWest:
+      return kSouth;
+    case kSouth:
+      return kEast;
+    case kEast:
+    default:
+      break;
+  }
+  return kNorth;
+}
+
+DirectionType TurnRight(DirectionType dir) {
+  switch (dir) {
+    case kNorth:
+      return kEast;
+    case kEast:
+      return kSouth;
+    case kSouth:
+      return kWest;
+    case kWest:
+    default:
+      break;
+  }
+  return kNorth;
+}
+
+bool operator==(const Coord& a, const Coord& b) {
+  return a.y == b.y && a.x == b.x && a.z == b.z;
+}
+
+Coord AddCoords(const Coord& c0, const Coord& c1) {
+  return {c0.y + c1.y, c0.x + c1.x, c0.z + c1.z};
+}
+
+template <typename Grid>
+bool OutOfBounds(const Coord& coord) {
+  if (coord.y < 0 || coord.y >= Grid::sizeY) {
+    return true;
+  }
+  if (coord.x < 0 || coord.x >= Grid::sizeX) {
+    return true;
+  }
+  if (coord.z < 0 || coord.z >= Grid::sizeZ) {
+    return true;
+  }
+  return false;
+}
+
+
+Coord MirrorCoord(const Coord& coord) {
+  return {coord.y, -coord.x, coord.z};
+}
+
+TrackCell MirrorTrackCell(const TrackCell& tc) {
+  return {
+    .coord = MirrorCoord(tc.coord), 
+    .cell = {tc.cell.c01, tc.cell.c00, tc.cell.c11, tc.cell.c10}};
+}
+
+TrackPiece MirrorTrackPiece(const TrackPiece& tp) {
+  TrackPiece mirroredPiece;
+  for (const auto& tc : tp.shape) {
+    mirroredPiece.shape.push_back(MirrorTrackCell(tc));
+  }
+  mirroredPiece.ptr = MirrorCoord(tp.ptr);
+  return mirroredPiece;
+}
+
+Coord RotateCoord(const Coord& coord) {
+  return {-coord.x, coord.y, coord.z};
+}
+
+TrackCell RotateTrackCell(const TrackCell& tc) {
+  return {
+    .coord = RotateCoord(tc.coord),
+    .cell = {tc.cell.c01, tc.cell.c11, tc.cell.c00, tc.cell.c10}};
+}
+
+TrackPiece RotateTrackPiece(const TrackPiece& tp) {
+  TrackPiece rotatedPiece;
+  for (const auto& tc : tp.shape) {
+    rotatedPiece.shape.push_back(RotateTrackCell(tc));
+  }
+  rotatedPiece.ptr = RotateCoord(tp.ptr);
+  return rotatedPiece;
+}
+
+uint64_t CellBits(const Cell& cell) {
+  return (cell.c00 ? 1 : 0) | (cell.c01 ? 2 : 0) | (cell.c10 ? 4 : 0)
+    | (cell.c11 ? 8 : 0);
+}
+
+// Appends the piece's rows to `tables.shapeRows`.
+CompiledPiece CompileTrackPiece(const TrackPiece& tp) {
+  CompiledPiece compiledPiece;
+  compiledPiece.ptr = tp.ptr;
+  compiledPiece.min = tp.shape[0].coord;
+  compiledPiece.max = tp.shape[0].coord;
+  for (const TrackCell& tc : tp.shape) {
+    compiledPiece.min = {
+      std::min(compiledPiece.min.y, tc.coord.y),
+      std::min(compiledPiece.min.x, tc.coord.x),
+      std::min(compiledPiece.min.z, tc.coord.z)};
+    compiledPiece.max = {
+      std::max(compiledPiece.max.y, tc.coord.y),
+      std::max(compiledPiece.max.x, tc.coord.x),
+      std::max(compiledPiece.max.z, tc.coord.z)};
+  }
+  if (compiledPiece.max.x - compiledPiece.min.x >= 8) {
+    std::cout << "Track piece too wide to compile" << std::endl;
+    abort();
+  }
+
+  compiledPiece.firstRow = tables.numShapeRows;
+  compiledPiece.numRows = 0;
+  SpaceRow *rows = &tables.shapeRows[compiledPiece.firstRow];
+  for (const TrackCell& tc : tp.shape) {
+    uint32_t bits =
+      CellBits(tc.cell) << (4 * (tc.coord.x - compiledPiece.min.x));
+    SpaceRow *row = std::find_if(rows, rows + compiledPiece.numRows,
+      [&tc](const SpaceRow& candidate) {
+        return candidate.y == tc.coord.y && candidate.z == tc.coord.z; });
+    if (row == rows + compiledPiece.numRows) {
+      if (tables.numShapeRows == kMaxShapeRows) {
+        std::cout << "Too many shape rows" << std::endl;
+        abort();
+      }
+      *row = {
+        static_cast<int8_t>(tc.coord.y), static_cast<int8_t>(tc.coord.z), 0};
+      compiledPiece.numRows++;
+      tables.numShapeRows++;
+    }
+    row->mask |= bits;
+  }
+  return compiledPiece;
+}
+
+// Mirrors and rotates the track data and compiles it to `tables`. Only the
+// first call does any work.
+void CompileTables() {
+  if (tables.numPieces != 0) {
+    return;
+  }
+
+  // Generate mirrored data.
+  for (auto [left, right]: mirrorMap) {
+    trackData[left] = MirrorTrackPiece(trackData[right]);
+  }
+
+  // Generate rotated data.
+  for (auto [trackType, trackPiece]: trackData) {
+    trackDataRot[{trackType, kNorth}] = trackPiece;
+    TrackPiece curTrack = trackPiece;
+    for (DirectionType dir : {kEast, kSouth, kWest}) {
+      curTrack = RotateTrackPiece(curTrack);
+      trackDataRot[{trackType, dir}] = curTrack;
+    }
+  }
+
+  // Number the pieces and compile their rotations.
+  std::fill(std::begin(tables.pieceIds), std::end(tables.pieceIds), kNoPiece);
+  for (const auto& [trackType, trackPiece] : trackData) {
+    if (trackType >= kMaxTrackTypes || tables.numPieces == kMaxPieces) {
+      std::cout << "Too many track pieces" << std::endl;
+      abort();
+    }
+    piece_id_t id = tables.numPieces++;
+    tables.pieceIds[trackType] = id;
+    tables.types[id] = trackType;
+    for (DirectionType dir : {kNorth, kEast, kSouth, kWest}) {
+      tables.pieces[id][dir] =
+        CompileTrackPiece(trackDataRot[{trackType, dir}]);
+    }
+
+    // The shape includes the clearance above the track.
+    std::set<std::pair<int, int>> tiles;
+    int peak = std::max(trackPiece.ptr.z, 0);
+    for (const auto& tc : trackPiece.shape) {
+      tiles.insert({tc.coord.y, tc.coord.x});
+      peak = std::max(peak, tc.coord.z - 1);
+    }
+    tables.peaks[id] = peak;
+    tables.lengths[id] = tiles.size();
+    tables.inversions[id] = trackType == TRACK_ELEM_LEFT_VERTICAL_LOOP
+      || trackType == TRACK_ELEM_RIGHT_VERTICAL_LOOP;
+
+    tables.turns[id] = 0;
+    auto it = dirStateMachine.find(trackType);
+    if (it != dirStateMachine.end()) {
+      tables.turns[id] = (it->second(kNorth) - kNorth + 4) % 4;
+    }
+  }
+
+  // Number the successor lists, sharing them like trackStateMachine does.
+  std::map<std::vector<track_type_t>*, uint8_t> listIds;
+  tables.numSuccessorLists = 1;
+  tables.numSuccessors[0] = 0;
+  for (int id = 0; id < tables.numPieces; ++id) {
+    tables.successorLists[id] = 0;
+    auto it = trackStateMachine.find(tables.types[id]);
+    if (it == trackStateMachine.end()) {
+      continue;
+    }
+
+    auto [listIt, inserted] = listIds.insert(
+      {it->second, tables.numSuccessorLists});
+    if (inserted) {
+      int list = tables.numSuccessorLists++;
+      if (list == kMaxSuccessorLists
+          || it->second->size() > kMaxSuccessors) {
+        std::cout << "Too many track successors" << std::endl;
+        abort();
+      }
+      tables.numSuccessors[list] = it->second->size();
+      for (size_t i = 0; i < it->second->size(); ++i) {
+        tables.successors[list][i] = tables.pieceIds[(*it->second)[i]];
+      }
+    }
+    tables.successorLists[id] = listIt->second;
+  }
+}
+
+// Computes the tables that depend on the grid size, unless the last call was
+// for the same size.
+template <typename Grid>
+void PrepareGrid() {
+  Coord size = {Grid::sizeY, Grid::sizeX, Grid::sizeZ};
+  if (size == preparedGrid) {
+    return;
+  }
+  preparedGrid = size;
+  ComputeOccupancyKeys<Grid>();
+  ComputeClosingDistances<Grid>();
+}
+
+template <typename Grid>
+void ComputeOccupancyKeys() {
+  // Fixed seed, so hashes are the same in every run.
+  std::mt19937_64 keyRng(0x5eed);
+  occupancyKeys.resize(Grid::numWords * 64);
+  for (uint64_t& key : occupancyKeys) {
+    key = keyRng();
+  }
+}
+
+// FNV-1a over `size` bytes.
+void HashBytes(uint64_t *hash, const void *data, size_t size) {
+  const uint8_t *bytes = static_cast<const uint8_t *>(data);
+  for (size_t i = 0; i < size; ++i) {
+    *hash = (*hash ^ bytes[i]) * 0x100000001b3;
+  }
+}
+
+void HashInt(uint64_t *hash, int64_t value) {
+  HashBytes(hash, &value, sizeof(value));
+}
+
+// Hash of everything the cached tables are computed from: the track data and
+// state machines, the grid and the end, and the layout of the cached structs.
+// Mirrored pieces are left out, CompileTables() adds them to trackData.
+template <typename Grid>
+uint64_t TableCacheKey() {
+  uint64_t hash = 0xcbf29ce484222325;
+  const int64_t layout[] = {
+    kTableCacheVersion,
+    static_cast<int64_t>(sizeof(PieceTables)),
+    static_cast<int64_t>(sizeof(Connector)),
+    Grid::sizeY, Grid::sizeX, Grid::sizeZ,
+    kEndCoord.y, kEndCoord.x, kEndCoord.z,
+    kConnectorDepth,
+  };
+  for (int64_t value : layout) {
+    HashInt(&hash, value);
+  }
+
+  for (const auto& [trackType, trackPiece] : trackData) {
+    if (mirrorMap.count(trackType) != 0) {
+      continue;
+    }
+    HashInt(&hash, trackType);
+    for (const TrackCell& tc : trackPiece.shape) {
+      const int values[] = {tc.coord.y, tc.coord.x, tc.coord.z,
+        tc.cell.c00, tc.cell.c01, tc.cell.c10, tc.cell.c11};
+      for (int value : values) {
+        HashInt(&hash, value);
+      }
+    }
+    HashInt(&hash, trackPiece.ptr.y);
+    HashInt(&hash, trackPiece.ptr.x);
+    HashInt(&hash, trackPiece.ptr.z);
+  }
+  for (const auto& [left, right] : mirrorMap) {
+    HashInt(&hash, left);
+    HashInt(&hash, right);
+  }
+  for (const auto& [trackType, turn] : dirStateMachine) {
+    HashInt(&hash, trackType);
+    HashInt(&hash, turn(kNorth));
+  }
+
+  // Lists are numbered by sharing, so which types share one matters too.
+  std::map<std::vector<track_type_t>*, int> listIds;
+  for (const auto& [trackType, successors] : trackStateMachine) {
+    auto [it, inserted] = listIds.insert({successors, listIds.size()});
+    HashInt(&hash, trackType);
+    HashInt(&hash, it->second);
+    if (inserted) {
+      for (track_type_t successor : *successors) {
+        HashInt(&hash, successor);
+      }
+    }
+  }
+  return hash;
+}
+
+// Whether every count and id in tables read from a cache file is within its
+// array, so a damaged or planted file can't make the search index past them.
+bool ValidTables(const PieceTables& cached) {
+  if (cached.numPieces < 1 || cached.numPieces > kMaxPieces
+      || cached.numShapeRows < 0 || cached.numShapeRows > kMaxShapeRows
+      || cached.numSuccessorLists < 1
+      || cached.numSuccessorLists > kMaxSuccessorLists) {
+    return false;
+  }
+  for (int type = 0; type < kMaxTrackTypes; ++type) {
+    piece_id_t id = cached.pieceIds[type];
+    if (id != kNoPiece
+        && (id >= cached.numPieces || cached.types[id] != type)) {
+      return false;
+    }
+  }
+
+  // Offsets stay within ConnectorKey()'s range, so adding them to a position
+  // on the grid can't overflow.
+  auto small = [](const Coord& coord) {
+    return std::abs(coord.y) < 64 && std::abs(coord.x) < 64
+      && std::abs(coord.z) < 64;
+  };
+  for (int id = 0; id < cached.numPieces; ++id) {
+    if (cached.types[id] >= kMaxTrackTypes
+        || cached.pieceIds[cached.types[id]] != id || cached.turns[id] >= 4
+        || cached.successorLists[id] >= cached.numSuccessorLists) {
+      return false;
+    }
+    for (const CompiledPiece& cp : cached.pieces[id]) {
+      int width = cp.max.x - cp.min.x + 1;
+      if (!small(cp.ptr) || !small(cp.min) || !small(cp.max)
+          || cp.min.y > cp.max.y || cp.min.z > cp.max.z
+          || width < 1 || width > 8
+          || cp.firstRow + cp.numRows > cached.numShapeRows) {
+        return false;
+      }
+      uint64_t widthMask = (uint64_t{1} << (4 * width)) - 1;
+      for (int row = cp.firstRow; row < cp.firstRow + cp.numRows; ++row) {
+        const SpaceRow& spaceRow = cached.shapeRows[row];
+        if (spaceRow.y < cp.min.y || spaceRow.y > cp.max.y
+            || spaceRow.z < cp.min.z || spaceRow.z > cp.max.z
+            || (spaceRow.mask & ~widthMask) != 0) {
+          return false;
+        }
+      }
+    }
+  }
+
+  for (int list = 0; list < cached.numSuccessorLists; ++list) {
+    if (cached.numSuccessors[list] > kMaxSuccessors) {
+      return false;
+    }
+    for (int i = 0; i < cached.numSuccessors[list]; ++i) {
+      if (cached.successors[list][i] >= cached.numPieces) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Whether every connector read from a cache file is within the steps, and
+// every step within the successor list it indexes, given tables that passed
+// ValidTables().
+bool ValidConnectors(
+  const PieceTables& cached,
+  const ConnectorLibrary& library) {
+
+  for (size_t c = 0; c < library.numConnectors; ++c) {
+    const Connector& connector = library.connectors[c];
+    if (connector.first > library.numSteps
+        || connector.length > library.numSteps - connector.first
+        || connector.length > kConnectorDepth) {
+      return false;
+    }
+    // The list the connector starts from, see ConnectorKey().
+    uint32_t list = connector.key / (4 * 128 * 128 * 128 * 4);
+    for (uint32_t j = 0; j < connector.length; ++j) {
+      if (list >= static_cast<uint32_t>(cached.numSuccessorLists)) {
+        return false;
+      }
+      int i = library.steps[connector.first + j];
+      if (i >= cached.numSuccessors[list]) {
+        return false;
+      }
+      list = cached.successorLists[cached.successors[list][i]];
+    }
+  }
+  return true;
+}
+
+// Maps the cache file at `path` and points the tables, the closing distances
+// and the connectors into it, if it's valid for `key`. It stays mapped for the
+// rest of the process, read-only and shared with every other process that
+// maps the same file, and is reused by later calls for the same path. The
+// PieceTables are small and copied out instead.
+template <typename Grid>
+bool LoadTableCache(const std::string& path, uint64_t key) {
+  auto mapped = mappedTableCaches.find(path);
+  void *data = MAP_FAILED;
+  uint64_t size = 0;
+  if (mapped != mappedTableCaches.end()) {
+    data = const_cast<char *>(mapped->second.first);
+    size = mapped->second.second;
+  } else {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat status;
+    if (fstat(fd, &status) == 0
+        && status.st_size >= static_cast<off_t>(sizeof(TableCacheHeader))) {
+      size = status.st_size;
+      data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (data == MAP_FAILED) {
+      return false;
+    }
+  }
+
+  const char *bytes = static_cast<const char *>(data);
+  TableCacheHeader header;
+  std::memcpy(&header, bytes, sizeof(header));
+  auto fits = [size](uint64_t offset, uint64_t count, uint64_t itemSize) {
+    return offset <= size && count <= (size - offset) / itemSize;
+  };
+  PieceTables cached;
+  bool valid = std::memcmp(header.magic, kTableCacheMagic, 8) == 0
+    && header.version == kTableCacheVersion
+    && header.headerSize == sizeof(TableCacheHeader)
+    && header.key == key
+    && header.fileSize == size
+    && header.tablesSize == sizeof(PieceTables)
+    && fits(header.tablesOffset, 1, sizeof(PieceTables))
+    && fits(header.distancesOffset, header.numDistances, 1)
+    && fits(header.connectorsOffset, header.numConnectors, sizeof(Connector))
+    && header.connectorsOffset % alignof(Connector) == 0
+    && fits(header.stepsOffset, header.numSteps, 1);
+  ConnectorLibrary library = {
+    .connectors =
+      reinterpret_cast<const Connector *>(bytes + header.connectorsOffset),
+    .numConnectors = header.numConnectors,
+    .steps = reinterpret_cast<const uint8_t *>(bytes + header.stepsOffset),
+    .numSteps = header.numSteps};
+  if (valid) {
+    std::memcpy(&cached, bytes + header.tablesOffset, sizeof(PieceTables));
+    valid = ValidTables(cached)
+      && header.numDistances == static_cast<uint64_t>(Grid::sizeY
+        * Grid::sizeX * Grid::sizeZ * 4 * cached.numSuccessorLists)
+      && ValidConnectors(cached, library);
+  }
+  if (!valid) {
+    if (mapped != mappedTableCaches.end()) {
+      mappedTableCaches.erase(mapped);
+    }
+    munmap(data, size);
+    return false;
+  }
+
+  mappedTableCaches[path] = {bytes, size};
+  tables = cached;
+  closingDistances =
+    reinterpret_cast<const uint8_t *>(bytes + header.distancesOffset);
+  numClosingDistances = header.numDistances;
+  connectorLibrary = library;
+  return true;
+}
+
+// Writes the tables, the closing distances and the connectors to a cache
+// file at `path`. It's written under a fresh temporary name and renamed into
+// place, so concurrent processes only ever see complete files.
+bool SaveTableCache(const std::string& path, uint64_t key) {
+  TableCacheHeader header = {};
+  std::memcpy(header.magic, kTableCacheMagic, 8);
+  header.version = kTableCacheVersion;
+  header.headerSize = sizeof(TableCacheHeader);
+  header.key = key;
+  uint64_t offset = sizeof(TableCacheHeader);
+  auto place = [&offset](uint64_t size) {
+    offset = (offset + kTableCacheAlignment - 1) / kTableCacheAlignment
+      * kTableCacheAlignment;
+    uint64_t start = offset;
+    offset += size;
+    return start;
+  };
+  header.tablesOffset = place(sizeof(PieceTables));
+  header.tablesSize = sizeof(PieceTables);
+  header.distancesOffset = place(numClosingDistances);
+  header.numDistances = numClosingDistances;
+  header.connectorsOffset =
+    place(connectorLibrary.numConnectors * sizeof(Connector));
+  header.numConnectors = connectorLibrary.numConnectors;
+  header.stepsOffset = place(connectorLibrary.numSteps);
+  header.numSteps = connectorLibrary.numSteps;
+  header.fileSize = offset;
+
+  std::vector<char> file(header.fileSize, 0);
+  std::memcpy(&file[0], &header, sizeof(header));
+  std::memcpy(&file[header.tablesOffset], &tables, sizeof(PieceTables));
+  std::memcpy(&file[header.distancesOffset], closingDistances,
+    numClosingDistances);
+  std::memcpy(&file[header.connectorsOffset], connectorLibrary.connectors,
+    connectorLibrary.numConnectors * sizeof(Connector));
+  std::memcpy(&file[header.stepsOffset], connectorLibrary.steps,
+    connectorLibrary.numSteps);
+
+  // mkstemp() picks an unused name and creates it exclusively, so nothing
+  // already in the directory, like a symlink, is ever written through.
+  std::string temporary = path + ".XXXXXX";
+  int fd = mkstemp(&temporary[0]);
+  if (fd < 0) {
+    return false;
+  }
+  bool written = true;
+  for (size_t done = 0; done < file.size() && written;) {
+    ssize_t count = write(fd, file.data() + done, file.size() - done);
+    written = count > 0;
+    done += written ? count : 0;
+  }
+  written = close(fd) == 0 && written;
+  if (!written || std::rename(temporary.c_str(), path.c_str()) != 0) {
+    unlink(temporary.c_str());
+    return false;
+  }
+  return true;
+}
+
+// Compiles the tables and the grid's closing distances, or maps them from the
+// table cache in GeneratorOptions::tableCache. A missing or stale cache is
+// rebuilt, with the connectors, and saved for the next process.
+template <typename Grid>
+void PrepareTables(const GeneratorOptions& options) {
+  Coord size = {Grid::sizeY, Grid::sizeX, Grid::sizeZ};
+  if (options.tableCache.empty() || size == preparedGrid) {
+    CompileTables();
+    PrepareGrid<Grid>();
+    return;
+  }
+
+  uint64_t key = TableCacheKey<Grid>();
+  std::ostringstream path;
+  path << options.tableCache << "/coaster-tables-" << std::hex
+    << std::setw(16) << std::setfill('0') << key << ".bin";
+  if (LoadTableCache<Grid>(path.str(), key)) {
+    preparedGrid = size;
+    ComputeOccupancyKeys<Grid>();
+    return;
+  }
+
+  CompileTables();
+  PrepareGrid<Grid>();
+  BuildConnectors();
+  if (!SaveTableCache(path.str(), key) && options.verbose) {
+    std::cout << "Couldn't save the table cache to " << path.str()
+      << std::endl;
+  }
+}
+
+template <typename Grid>
+int DistanceIndex(const Coord& ptr, int dir, int list) {
+  int tile = (Grid::sizeY * ptr.z + ptr.y) * Grid::sizeX + ptr.x;
+  return (tile * 4 + dir) * tables.numSuccessorLists + list;
+}
+
+template <typename Grid>
+uint8_t ClosingDistance(const Coord& ptr, int dir, int list) {
+  return closingDistances[DistanceIndex<Grid>(ptr, dir, list)];
+}
+
+template <typename Grid>
+bool PieceInBounds(const Coord& ptr, int dir, piece_id_t piece) {
+  const CompiledPiece& cp = tables.pieces[piece][dir];
+  return !OutOfBounds<Grid>(ptr)
+    && !OutOfBounds<Grid>(AddCoords(ptr, cp.min))
+    && !OutOfBounds<Grid>(AddCoords(ptr, cp.max))
+    && !OutOfBounds<Grid>(AddCoords(ptr, cp.ptr));
+}
+
+// Weights every successor of every list and builds the alias tables with
+// Vose's method.
+void CompileTrackWeights(
+  const GeneratorOptions& options,
+  TrackWeights *weights) {
+
+  for (int list = 0; list < tables.numSuccessorLists; ++list) {
+    int size = tables.numSuccessors[list];
+    float total = 0;
+    weights->enabled[list] = 0;
+    for (int i = 0; i < size; ++i) {
+      track_type_t type = tables.types[tables.successors[list][i]];
+      float weight = 1;
+      if (type == TRACK_ELEM_LEFT_VERTICAL_LOOP
+          || type == TRACK_ELEM_RIGHT_VERTICAL_LOOP) {
+        weight = kLoopWeight;
+      }
+      auto it = options.trackWeights.find(type);
+      if (it != options.trackWeights.end()) {
+        weight = std::max(it->second, 0.0f);
+      }
+      weights->weights[list][i] = weight;
+      total += weight;
+      if (weight > 0) {
+        weights->enabled[list] |= 1u << i;
+      }
+    }
+
+    // Scale the weights so they average 1, then pair every slot below 1 with
+    // one above it that tops it up.
+    float scaled[kMaxSuccessors];
+    int small[kMaxSuccessors];
+    int large[kMaxSuccessors];
+    int numSmall = 0;
+    int numLarge = 0;
+    for (int i = 0; i < size; ++i) {
+      scaled[i] = total > 0 ? weights->weights[list][i] * size / total : 0;
+      if (scaled[i] < 1) {
+        small[numSmall++] = i;
+      } else {
+        large[numLarge++] = i;
+      }
+    }
+    while (numSmall > 0 && numLarge > 0) {
+      int less = small[--numSmall];
+      int more = large[--numLarge];
+      weights->probability[list][less] = scaled[less];
+      weights->alias[list][less] = more;
+      scaled[more] -= 1 - scaled[less];
+      if (scaled[more] < 1) {
+        small[numSmall++] = more;
+      } else {
+        large[numLarge++] = more;
+      }
+    }
+    // What's left is 1 up to rounding.
+    while (numLarge > 0) {
+      int i = large[--numLarge];
+      weights->probability[list][i] = 1;
+      weights->alias[list][i] = i;
+    }
+    while (numSmall > 0) {
+      int i = small[--numSmall];
+      weights->probability[list][i] = 1;
+      weights->alias[list][i] = i;
+    }
+  }
+}
+
+// splitmix64 spreads the seed over the whole state.
+void SeedRandom(Random *random, uint64_t seed) {
+  for (uint64_t& word : random->state) {
+    seed += 0x9e3779b97f4a7c15;
+    uint64_t z = seed;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    word = z ^ (z >> 31);
+  }
+}
+
+uint64_t NextRandom(Random *random) {
+  uint64_t *s = random->state;
+  uint64_t x = s[1] * 5;
+  uint64_t result = ((x << 7) | (x >> 57)) * 9;
+  uint64_t t = s[1] << 17;
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = (s[3] << 45) | (s[3] >> 19);
+  return result;
+}
+
+// Unbiased, using Lemire's multiply and reject.
+uint32_t RandomBelow(Random *random, uint32_t n) {
+  uint64_t product = (NextRandom(random) >> 32) * n;
+  if (static_cast<uint32_t>(product) < n) {
+    uint32_t threshold = -n % n;
+    while (static_cast<uint32_t>(product) < threshold) {
+      product = (NextRandom(random) >> 32) * n;
+    }
+  }
+  return product >> 32;
+}
+
+// Uniform in [0, 1).
+float RandomUnit(Random *random) {
+  return (NextRandom(random) >> 40) * 0x1.0p-24f;
+}
+
+// Breadth-first search backwards from the end over every transition of the
+// state machine whose piece fits in the grid.
+template <typename Grid>
+void ComputeClosingDistances() {
+  int numLists = tables.numSuccessorLists;
+  computedDistances.assign(
+    Grid::sizeY * Grid::sizeX * Grid::sizeZ * 4 * numLists, kUnreachable);
+  closingDistances = computedDistances.data();
+  numClosingDistances = computedDistances.size();
+
+  // Pieces leading into each successor list, and the lists each piece is in.
+  std::vector<std::vector<piece_id_t>> piecesWithList(numLists);
+  std::vector<std::vector<int>> listsWithPiece(tables.numPieces);
+  for (int id = 0; id < tables.numPieces; ++id) {
+    piecesWithList[tables.successorLists[id]].push_back(id);
+  }
+  for (int list = 0; list < numLists; ++list) {
+    for (int i = 0; i < tables.numSuccessors[list]; ++i) {
+      listsWithPiece[tables.successors[list][i]].push_back(list);
+    }
+  }
+
+  struct State {
+    Coord ptr;
+    int dir;
+    int list;
+  };
+  std::deque<State> queue;
+  for (int list = 0; list < numLists; ++list) {
+    computedDistances[DistanceIndex<Grid>(kEndCoord, kEast, list)] = 0;
+    queue.push_back({kEndCoord, kEast, list});
+  }
+
+  while (!queue.empty()) {
+    State state = queue.front();
+    queue.pop_front();
+    uint8_t distance =
+      ClosingDistance<Grid>(state.ptr, state.dir, state.list);
+    // Further states are left at kUnreachable, see there.
+    if (distance + 1 == kUnreachable) {
+      continue;
+    }
+
+    // Every piece that ends in this state, placed from wherever it fits.
+    for (piece_id_t piece : piecesWithList[state.list]) {
+      int dir = (state.dir - tables.turns[piece] + 4) % 4;
+      const Coord& offset = tables.pieces[piece][dir].ptr;
+      Coord ptr = {
+        state.ptr.y - offset.y, state.ptr.x - offset.x, state.ptr.z - offset.z};
+      if (!PieceInBounds<Grid>(ptr, dir, piece)) {
+        continue;
+      }
+      for (int list : listsWithPiece[piece]) {
+        uint8_t& previous =
+          computedDistances[DistanceIndex<Grid>(ptr, dir, list)];
+        if (previous == kUnreachable) {
+          previous = distance + 1;
+          queue.push_back({ptr, dir, list});
+        }
+      }
+    }
+  }
+}
+
+template <typename Grid>
+int RowIndex(int y, int z) {
+  return (Grid::sizeY * z + y) * Grid::wordsPerRow;
+}
+
+// The grid's hash is the XOR of the keys of its set bits, so setting and
+// clearing `bits` of word `index` both XOR this into it.
+uint64_t OccupancyHash(int index, uint64_t bits) {
+  const uint64_t *keys = &occupancyKeys[index * 64];
+  uint64_t hash = 0;
+  while (bits != 0) {
+    hash ^= keys[__builtin_ctzll(bits)];
+    bits &= bits - 1;
+  }
+  return hash;
+}
+
+void SetOwners(Space *space, int index, uint64_t bits, int owner) {
+  if (space->owners.empty()) {
+    return;
+  }
+  uint16_t *owners = &space->owners[index * 64];
+  while (bits != 0) {
+    owners[__builtin_ctzll(bits)] = owner;
+    bits &= bits - 1;
+  }
+}
+
+int ShallowestOwner(const Space& space, int index, uint64_t bits) {
+  const uint16_t *owners = &space.owners[index * 64];
+  int owner = std::numeric_limits<int>::max();
+  while (bits != 0) {
+    owner = std::min<int>(owner, owners[__builtin_ctzll(bits)]);
+    bits &= bits - 1;
+  }
+  return owner;
+}
+
+template <typename Grid>
+void WriteSpace(Space *space, const Coord& ptr, Cell newCells) {
+  int bit = 4 * ptr.x;
+  int index = RowIndex<Grid>(ptr.y, ptr.z) + bit / 64;
+  uint64_t bits = (CellBits(newCells) << (bit % 64)) & ~space->words[index];
+  space->undoLog.push_back({index, bits});
+  space->words[index] |= bits;
+  space->hash ^= OccupancyHash(index, bits);
+  SetOwners(space, index, bits, 0);
+}
+
+// Reverts every write made since the undo log was `undoOffset` long.
+void UndoSpace(Space *space, size_t undoOffset) {
+  while (space->undoLog.size() > undoOffset) {
+    const UndoEntry& entry = space->undoLog.back();
+    space->words[entry.index] ^= entry.bits;
+    space->hash ^= OccupancyHash(entry.index, entry.bits);
+    space->undoLog.pop_back();
+  }
+}
+
+// Checks the whole piece before writing anything, so on failure `space` is
+// left untouched. With ownership tracking the piece's bits are owned by
+// `owner`, and on a collision `blocker` is set to the shallowest owner of the
+// bits in the way.
+template <typename Grid>
+bool AddTrackToSpace(
+  Space *space,
+  const Coord& ptr,
+  DirectionType dir, 
+  const TrackDesignTrackElement& track,
+  int owner,
+  size_t *blocker) {
+
+  const CompiledPiece& cp = tables.pieces[tables.pieceIds[track.type]][dir];
+  if (OutOfBounds<Grid>(AddCoords(ptr, cp.min))
+      || OutOfBounds<Grid>(AddCoords(ptr, cp.max))) {
+    return false;
+  }
+  const SpaceRow *rows = &tables.shapeRows[cp.firstRow];
+  const SpaceRow *rowsEnd = rows + cp.numRows;
+
+  // A row mask may straddle two words. The high part is shifted in two steps
+  // so that a zero shift doesn't shift by 64, and the word after the last row
+  // is padding, so reading it with an empty mask is harmless.
+  int bit = 4 * (ptr.x + cp.min.x);
+  int word = bit / 64;
+  int shift = bit % 64;
+  uint64_t collision = 0;
+  for (const SpaceRow *row = rows; row != rowsEnd; ++row) {
+    uint64_t mask = row->mask;
+    int index = RowIndex<Grid>(ptr.y + row->y, ptr.z + row->z) + word;
+    collision |= space->words[index] & (mask << shift);
+    collision |= space->words[index + 1] & ((mask >> 1) >> (63 - shift));
+  }
+  if (collision != 0) {
+    if (!space->owners.empty() && blocker != nullptr) {
+      int shallowest = std::numeric_limits<int>::max();
+      for (const SpaceRow *row = rows; row != rowsEnd; ++row) {
+        uint64_t mask = row->mask;
+        int index = RowIndex<Grid>(ptr.y + row->y, ptr.z + row->z) + word;
+        shallowest = std::min(shallowest, ShallowestOwner(*space, index,
+          space->words[index] & (mask << shift)));
+        shallowest = std::min(shallowest, ShallowestOwner(*space, index + 1,
+          space->words[index + 1] & ((mask >> 1) >> (63 - shift))));
+      }
+      *blocker = shallowest;
+    }
+    return false;
+  }
+
+  for (const SpaceRow *row = rows; row != rowsEnd; ++row) {
+    uint64_t mask = row->mask;
+    int index = RowIndex<Grid>(ptr.y + row->y, ptr.z + row->z) + word;
+    uint64_t lo = mask << shift;
+    uint64_t hi = (mask >> 1) >> (63 - shift);
+    space->words[index] |= lo;
+    space->undoLog.push_back({index, lo});
+    space->hash ^= OccupancyHash(index, lo);
+    SetOwners(space, index, lo, owner);
+    if (hi != 0) {
+      space->words[index + 1] |= hi;
+      space->undoLog.push_back({index + 1, hi});
+      space->hash ^= OccupancyHash(index + 1, hi);
+      SetOwners(space, index + 1, hi, owner);
+    }
+  }
+  return true;
+}
+
+template <typename Grid>
+bool AddTrackToStack(
+  Search *search,
+  const TrackDesignTrackElement& track) {
+
+  // Not a reference, the push below may reallocate the stack.
+  const Coord lastPtr = search->stack.back().ptr;
+  const DirectionType lastDir = search->stack.back().dir;
+
+  // Debug
+  // auto p = lastPtr;
+  // std::cout << "At " << p.y << ", " << p.x << ", " << p.z << std::endl;
+
+  // Unless the piece collides, its position is to blame for rejecting it,
+  // which the last piece decided.
+  search->blocker = search->stack.size() - 1;
+
+  piece_id_t piece = tables.pieceIds[track.type];
+  const CompiledPiece& trackPiece = tables.pieces[piece][lastDir];
+  Coord newPtr = AddCoords(lastPtr, trackPiece.ptr);
+  if (OutOfBounds<Grid>(newPtr)) {
+    CountRejection(search, track.type, kRejectPointerOutOfBounds);
+    return false;
+  }
+
+  DirectionType newDir =
+    static_cast<DirectionType>((lastDir + tables.turns[piece]) % 4);
+
+  // Prune states that can't get back to the station within the remaining
+  // budget of pieces. Arriving too early is a dead end as well, the end tile
+  // is reserved. Station pieces have no successors and only appear in the
+  // initial track, which isn't pruned.
+  int list = tables.successorLists[piece];
+  if (list != 0) {
+    size_t newSize = search->path.size() + 1;
+    uint8_t distance = ClosingDistance<Grid>(newPtr, newDir, list);
+    if (distance == kUnreachable) {
+      CountRejection(search, track.type, kRejectUnreachable);
+      return false;
+    }
+    if (newSize + distance > search->options->maximumTrackSize) {
+      CountRejection(search, track.type, kRejectTooLong);
+      return false;
+    }
+    if (distance == 0 && newSize <= search->options->minimumTrackSize) {
+      CountRejection(search, track.type, kRejectTooEarly);
+      return false;
+    }
+  }
+
+  float energy = 0;
+  if (search->options->minimumClimb > 0) {
+    energy = NextEnergy(*search, track, trackPiece.ptr.z);
+    if (energy < 0) {
+      CountRejection(search, track.type, kRejectTooSlow);
+      return false;
+    }
+  }
+
+  size_t undoOffset = search->space.undoLog.size();
+  if (!AddTrackToSpace<Grid>(&search->space, lastPtr, lastDir, track,
+                             search->stack.size(), &search->blocker)) {
+    // Only profiling tells the two failures apart, the search doesn't care.
+    if (kProfile) {
+      bool inBounds = !OutOfBounds<Grid>(AddCoords(lastPtr, trackPiece.min))
+        && !OutOfBounds<Grid>(AddCoords(lastPtr, trackPiece.max));
+      CountRejection(search, track.type,
+        inBounds ? kRejectCollision : kRejectShapeOutOfBounds);
+    }
+    return false;
+  }
+
+  // The rating only depends on the path, not on the state, so a frame that
+  // turned down a boring coaster isn't proven dead.
+  RideFeatures features = AddFeatures(search->stack.back().features, piece);
+  float minimumExcitement = search->options->minimumExcitement;
+  if (minimumExcitement > 0 && newPtr == kEndCoord && newDir == kEast
+      && EstimateRatings(features).excitement < minimumExcitement) {
+    CountRejection(search, track.type, kRejectBoring);
+    search->stack.back().incomplete = true;
+    UndoSpace(&search->space, undoOffset);
+    return false;
+  }
+
+  uint64_t stateKey = StateKey<Grid>(search->space.hash, newPtr, newDir,
+    list, search->path.size() + 1);
+  if (IsDeadState(search, stateKey, energy)) {
+    CountRejection(search, track.type, kRejectDeadState);
+    UndoSpace(&search->space, undoOffset);
+    return false;
+  }
+
+  search->stats.nodes++;
+  search->path.push_back(track);
+  search->stack.push_back(GeneratorInfo{
+    .undoOffset = undoOffset, 
+    .ptr = newPtr,
+    .dir = newDir,
+    .failedTracks = 0,
+    .closingTried = false,
+    .connectorTried = false,
+    .incomplete = false,
+    .stateKey = stateKey,
+    .energy = energy,
+    .features = features});
+  ClearConflicts(search, search->stack.size() - 1);
+  return true;
+}
+
+// Position of `type` in successor list `list`, which has to contain it. That's
+// the bit of failedTracks that stands for it.
+int SuccessorIndex(int list, track_type_t type) {
+  int i = 0;
+  while (tables.types[tables.successors[list][i]] != type) {
+    i++;
+  }
+  return i;
+}
+
+// Returns the index of the available successor closest to the end, breaking
+// ties at random.
+template <typename Grid>
+int ChooseClosingTrack(Search *search, int list, uint16_t available) {
+  const GeneratorInfo& lastInfo = search->stack.back();
+  int size = tables.numSuccessors[list];
+  int offset = RandomBelow(&search->random, size);
+  int best = -1;
+  int bestDistance = kUnreachable + 1;
+  for (int j = 0; j < size; ++j) {
+    int i = (offset + j) % size;
+    if ((available & (1u << i)) == 0) {
+      continue;
+    }
+    piece_id_t piece = tables.successors[list][i];
+    Coord ptr = AddCoords(lastInfo.ptr, tables.pieces[piece][lastInfo.dir].ptr);
+    int distance = kUnreachable;
+    if (!OutOfBounds<Grid>(ptr)) {
+      int dir = (lastInfo.dir + tables.turns[piece]) % 4;
+      distance =
+        ClosingDistance<Grid>(ptr, dir, tables.successorLists[piece]);
+    }
+    if (distance < bestDistance) {
+      best = i;
+      bestDistance = distance;
+    }
+  }
+  return best;
+}
+
+// Returns the index of an available successor, picked by weight. While few
+// successors have failed, drawing from the list's alias table and skipping
+// failed ones is O(1).
+int PickWeightedTrack(Search *search, int list, uint16_t available) {
+  const TrackWeights& weights = *search->weights;
+  int size = tables.numSuccessors[list];
+  for (int tries = 0; tries < kAliasTries; ++tries) {
+    int i = RandomBelow(&search->random, size);
+    if (RandomUnit(&search->random) >= weights.probability[list][i]) {
+      i = weights.alias[list][i];
+    }
+    if (available & (1u << i)) {
+      return i;
+    }
+  }
+
+  float total = 0;
+  for (int i = 0; i < size; ++i) {
+    if (available & (1u << i)) {
+      total += weights.weights[list][i];
+    }
+  }
+  float target = RandomUnit(&search->random) * total;
+  int last = -1;
+  for (int i = 0; i < size; ++i) {
+    if (available & (1u << i)) {
+      target -= weights.weights[list][i];
+      last = i;
+      if (target < 0) {
+        break;
+      }
+    }
+  }
+  return last;
+}
+
+// Successors with a weight of 0, and those in `failedTracks`, are never
+// tried. Pieces blamed for the rejections are added to the top frame's
+// conflicts, except for those below `rootDepth`, which never move.
+template <typename Grid>
+bool ChooseTrack(
+  Search *search,
+  uint16_t *failedTracks,
+  piece_id_t lastPiece,
+  size_t rootDepth) {
+
+  int list = tables.successorLists[lastPiece];
+  const piece_id_t *successors = tables.successors[list];
+  uint16_t available = search->weights->enabled[list] & ~*failedTracks;
+  while (available != 0) {
+    int i;
+    if (search->path.size() >= search->options->minimumTrackSize) {
+      // Long enough, head back to the station.
+      i = ChooseClosingTrack<Grid>(search, list, available);
+    } else {
+      i = PickWeightedTrack(search, list, available);
+    }
+
+    track_type_t nextTrack = tables.types[successors[i]];
+    if (AddTrackToStack<Grid>(search, {nextTrack, 4})) {
+      return true;
+    }
+    *failedTracks |= 1u << i;
+    available &= ~(1u << i);
+    AddConflict(search, search->blocker >= rootDepth
+      ? search->blocker : search->stack.size() - 1);
+  }
+  return false;
+}
+
+// Everything but the train's speed that decides whether a path can still be
+// completed: the grid, where the path ends, what may follow it and how many
+// pieces it has. A faster train can make it over every piece a slower one
+// can, so the table of dead states keeps the speed next to the key, see
+// IsDeadState().
+template <typename Grid>
+uint64_t StateKey(
+  uint64_t hash,
+  const Coord& ptr,
+  DirectionType dir,
+  int list,
+  size_t size) {
+
+  uint64_t key = MixKey(hash ^ DistanceIndex<Grid>(ptr, dir, list));
+  return MixKey(key ^ size);
+}
+
+// The finalizer of SplitMix64.
+uint64_t MixKey(uint64_t key) {
+  key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9;
+  key = (key ^ (key >> 27)) * 0x94d049bb133111eb;
+  return key ^ (key >> 31);
+}
+
+// The train's energy after `track`, which climbs `rise` levels, or a negative
+// value if it doesn't make it over the piece with at least
+// GeneratorOptions::minimumClimb to spare, which has to be positive. Station
+// pieces launch the train and lift hills pull it up, so only the pieces after
+// them can stall it.
+float NextEnergy(
+  const Search& search,
+  const TrackDesignTrackElement& track,
+  int rise) {
+
+  piece_id_t piece = tables.pieceIds[track.type];
+  float energy = search.stack.back().energy;
+  if (tables.successorLists[piece] == 0) {
+    return std::max(energy, kLaunchClimb);
+  }
+  energy -= kFrictionPerTile * tables.lengths[piece];
+  if (track.flags & kLiftFlag) {
+    return std::max(energy - rise, kLiftClimb);
+  }
+  if (energy - tables.peaks[piece] < search.options->minimumClimb) {
+    return -1;
+  }
+  return energy - rise;
+}
+
+// The features of a path extended by `piece`. Every turn the search places is
+// banked, and a drop is a run of pieces going down.
+RideFeatures AddFeatures(const RideFeatures& features, piece_id_t piece) {
+  RideFeatures next = features;
+  int rise = tables.pieces[piece][kNorth].ptr.z;
+  next.length += tables.lengths[piece];
+  next.inversions += tables.inversions[piece];
+  next.turns += tables.turns[piece] != 0;
+  if (rise < 0) {
+    next.drops += features.drop == 0;
+    next.drop += -rise;
+    next.maxDrop = std::max(next.maxDrop, next.drop);
+  } else {
+    next.drop = 0;
+  }
+  return next;
+}
+
+RideRatings EstimateRatings(const RideFeatures& features) {
+  auto estimate = [&features](float RideRatings::*rating) {
+    return kRatingBase.*rating
+      + kRatingPerTile.*rating * features.length
+      + kRatingPerInversion.*rating * features.inversions
+      + kRatingPerTurn.*rating * features.turns
+      + kRatingPerDrop.*rating * features.drops
+      + kRatingPerDropLevel.*rating * features.maxDrop;
+  };
+  RideRatings ratings = {
+    .excitement = estimate(&RideRatings::excitement),
+    .intensity = estimate(&RideRatings::intensity),
+    .nausea = estimate(&RideRatings::nausea)};
+  if (ratings.intensity > kMaxEnjoyableIntensity) {
+    ratings.excitement -= (ratings.intensity - kMaxEnjoyableIntensity) / 2;
+  }
+  ratings.excitement = std::max(ratings.excitement, 0.0f);
+  return ratings;
+}
+
+// Compiles to nothing without kProfile.
+void CountRejection(Search *search, track_type_t type, RejectReason reason) {
+  if (kProfile) {
+    search->stats.profile.rejections[type][reason]++;
+  }
+}
+
+// A state is dead if it was proven dead with a train at least as fast.
+bool IsDeadState(Search *search, uint64_t key, float energy) {
+  if (search->deadStates.empty()) {
+    return false;
+  }
+  search->stats.deadStateProbes++;
+  const DeadState& dead =
+    search->deadStates[key & (search->deadStates.size() - 1)];
+  if (dead.key != key || energy > dead.energy) {
+    return false;
+  }
+  search->stats.deadStateHits++;
+  return true;
+}
+
+// Newer states replace older ones in the same slot. The same state keeps the
+// fastest train it was proven dead with.
+void AddDeadState(Search *search, uint64_t key, float energy) {
+  if (search->deadStates.empty()) {
+    return;
+  }
+  search->stats.deadStateStores++;
+  DeadState& dead = search->deadStates[key & (search->deadStates.size() - 1)];
+  if (dead.key == key) {
+    dead.energy = std::max(dead.energy, energy);
+  } else {
+    dead = {key, energy};
+  }
+}
+
+void ClearConflicts(Search *search, size_t depth) {
+  if (!search->conflicts.empty()) {
+    uint64_t *conflicts = &search->conflicts[depth * search->conflictWords];
+    std::fill(conflicts, conflicts + search->conflictWords, 0);
+  }
+}
+
+// Blames the piece at `depth` for a failure below the top frame.
+void AddConflict(Search *search, size_t depth) {
+  if (!search->conflicts.empty()) {
+    size_t top = search->stack.size() - 1;
+    search->conflicts[top * search->conflictWords + depth / 64] |=
+      1ull << (depth % 64);
+  }
+}
+
+// Pops the top frame, which ran out of candidates, and marks the piece that
+// led to it as failed. With backjumping, every frame up to the deepest piece
+// blamed for its failures is popped instead: the pieces in between didn't
+// cause them, so other choices for them would most likely fail the same way.
+// Jumping is a heuristic, the frame jumped to can't be proven dead anymore.
+void Backtrack(Search *search, size_t rootDepth) {
+  std::vector<GeneratorInfo>& stack = search->stack;
+  size_t top = stack.size() - 1;
+  size_t culprit = top;
+  if (!search->conflicts.empty()) {
+    const uint64_t *conflicts = &search->conflicts[top * search->conflictWords];
+    for (int i = search->conflictWords - 1; i >= 0; --i) {
+      if (conflicts[i] != 0) {
+        culprit = i * 64 + 63 - __builtin_clzll(conflicts[i]);
+        break;
+      }
+    }
+    if (culprit < rootDepth) {
+      culprit = top;
+    }
+
+    // The remaining conflicts are still to blame once the culprit moves.
+    uint64_t *merged =
+      &search->conflicts[(culprit - 1) * search->conflictWords];
+    for (int i = 0; i < search->conflictWords; ++i) {
+      merged[i] |= conflicts[i];
+    }
+    merged[culprit / 64] &= ~(1ull << (culprit % 64));
+  }
+
+  GeneratorInfo& parent = stack[culprit - 1];
+  if (stack.back().incomplete || culprit != top) {
+    parent.incomplete = true;
+  }
+  if (culprit != top) {
+    search->stats.backjumps++;
+    search->stats.jumpedFrames += top - culprit;
+  }
+
+  int list = tables.successorLists[
+    tables.pieceIds[search->path[culprit - 2].type]];
+  parent.failedTracks |=
+    1u << SuccessorIndex(list, search->path[culprit - 1].type);
+  UndoSpace(&search->space, stack[culprit].undoOffset);
+  stack.erase(stack.begin() + culprit, stack.end());
+  search->path.resize(culprit - 1);
+}
+
+// Clears the grid and leaves only the root frame on the stack.
+template <typename Grid>
+void ResetSearch(Search *search) {
+  Space& space = search->space;
+  std::fill(space.words.begin(), space.words.end(), 0);
+  space.undoLog.clear();
+  space.hash = 0;
+  search->stack.clear();
+  search->path.clear();
+
+  // Reserve space for entrance/exit.
+  /*
+  for (int z = 0; z < 4; ++z) {
+    for (int y = 5; y < 7; ++y) {
+      for (int x = 10; x < 12; ++x) {
+        WriteSpace<Grid>(&space, {y, x, z}, {1, 1, 1, 1});
+      }
+    }
+  }
+  */
+
+  // Reserve tile before station begin.
+  WriteSpace<Grid>(&space, kEndCoord, {1, 1, 1, 1});
+  WriteSpace<Grid>(&space, {kEndCoord.y, kEndCoord.x, kEndCoord.z + 1},
+    {1, 1, 1, 1});
+
+  search->stack.push_back(GeneratorInfo{
+    .undoOffset = space.undoLog.size(), 
+    .ptr = kStartCoord,
+    .dir = kEast,
+    .failedTracks = 0,
+    .closingTried = false,
+    .connectorTried = false,
+    .incomplete = false,
+    .stateKey = 0,
+    .energy = 0,
+    .features = {}});
+  ClearConflicts(search, 0);
+}
+
+// Resets the search and places the initial track. If that fails no attempt
+// can ever succeed, so every worker is stopped.
+template <typename Grid>
+bool StartAttempt(Search *search, Portfolio *portfolio) {
+  ResetSearch<Grid>(search);
+
+  // Generate initial track.
+  static const TrackDesignTrackElement tracksToAdd[] = {
+    {TRACK_ELEM_BEGIN_STATION, 4},
+    {TRACK_ELEM_MIDDLE_STATION, 4},
+    {TRACK_ELEM_MIDDLE_STATION, 4},
+    {TRACK_ELEM_END_STATION, 4},
+    {TRACK_ELEM_FLAT_TO_LEFT_BANKED_25_DEG_UP, 4},
+    {TRACK_ELEM_LEFT_BANKED_QUARTER_TURN_5_TILE_25_DEG_UP, 4},
+    {TRACK_ELEM_LEFT_BANKED_QUARTER_TURN_5_TILE_25_DEG_UP, 4},
+  };
+
+  for (const auto& track : tracksToAdd) {
+    if (!AddTrackToStack<Grid>(search, track)) {
+      if (search->options->verbose) {
+        std::lock_guard<std::mutex> lock(portfolio->mutex);
+        std::cerr << "Failed to add " << track.type << std::endl;
+      }
+      portfolio->done = true;
+      return false;
+    }
+  }
+  return true;
+}
+
+// The i-th term (from 0) of the Luby sequence 1, 1, 2, 1, 1, 2, 4, 1, 1, 2,
+// 1, 1, 2, 4, 8, ...
+int Luby(int i) {
+  // Find the complete subsequence of 2^k - 1 terms that contains i, then the
+  // term's position within the first half of it, until i is its last term.
+  int size = 1;
+  int power = 0;
+  while (size < i + 1) {
+    power++;
+    size = 2 * size + 1;
+  }
+  while (size - 1 != i) {
+    size = (size - 1) / 2;
+    power--;
+    i %= size;
+  }
+  return 1 << power;
+}
+
+// Steps the `restart`-th attempt (from 0) may take before giving up.
+int AttemptBudget(const GeneratorOptions& options, int restart) {
+  double scale = 1;
+  if (options.restartPolicy == kRestartLuby) {
+    scale = Luby(restart);
+  } else if (options.restartPolicy == kRestartGeometric) {
+    scale = std::pow(kRestartGrowth, restart);
+  }
+  return static_cast<int>(std::min<double>(options.tryPerAttempt * scale,
+                                           kMaxAttemptBudget));
+}
+
+// Drops the top of the stack down to a random frame among the first
+// 1 / kCheckpointFraction of those above `rootDepth`, keeping the initial
+// track and the candidates already ruled out in the frames that remain.
+void RewindToCheckpoint(Search *search, size_t rootDepth) {
+  std::vector<GeneratorInfo>& stack = search->stack;
+  if (stack.size() <= rootDepth) {
+    return;
+  }
+  size_t span = (stack.size() - rootDepth) / kCheckpointFraction;
+  size_t depth = rootDepth + RandomBelow(&search->random, span + 1);
+
+  // Nothing above the checkpoint was exhausted, so no dead states are learned
+  // and the piece that left it stays a candidate.
+  UndoSpace(&search->space, stack[depth].undoOffset);
+  stack.erase(stack.begin() + depth, stack.end());
+  search->path.resize(depth - 1);
+}
+
+// Grows every track of up to kBackwardDepth pieces that ends with `suffix`,
+// which starts at `ptr` facing `dir`, by inverting the state machine: a piece
+// can go before the suffix if the suffix's first piece is one of its
+// successors, and it's placed at `ptr` minus its own offset. Each track is
+// checked against the grid and the rest of the track.
+template <typename Grid>
+void GrowBackwardTracks(
+  Search *search,
+  const Coord& ptr,
+  DirectionType dir,
+  std::vector<piece_id_t> *suffix,
+  BackwardTracks *backwardTracks) {
+
+  piece_id_t next = suffix->empty() ? kNoPiece : suffix->front();
+  for (int piece = 0; piece < tables.numPieces; ++piece) {
+    int list = tables.successorLists[piece];
+    const piece_id_t *successors = tables.successors[list];
+    const piece_id_t *successorsEnd = successors + tables.numSuccessors[list];
+    if (list == 0 || (next != kNoPiece
+        && std::find(successors, successorsEnd, next) == successorsEnd)) {
+      continue;
+    }
+
+    DirectionType newDir =
+      static_cast<DirectionType>((dir - tables.turns[piece] + 4) % 4);
+    const Coord& offset = tables.pieces[piece][newDir].ptr;
+    Coord newPtr = {ptr.y - offset.y, ptr.x - offset.x, ptr.z - offset.z};
+    if (!PieceInBounds<Grid>(newPtr, newDir, piece)) {
+      continue;
+    }
+
+    size_t undoOffset = search->space.undoLog.size();
+    if (!AddTrackToSpace<Grid>(&search->space, newPtr, newDir,
+                               {tables.types[piece], 4}, 0, nullptr)) {
+      continue;
+    }
+
+    // Tracks are stored in driving order, so the new piece goes first.
+    suffix->insert(suffix->begin(), piece);
+    backwardTracks->tracks.push_back(BackwardTrack{
+      .ptr = newPtr,
+      .dir = newDir,
+      .first = static_cast<uint32_t>(backwardTracks->pieces.size()),
+      .length = static_cast<uint32_t>(suffix->size())});
+    backwardTracks->pieces.insert(backwardTracks->pieces.end(),
+      suffix->begin(), suffix->end());
+    if (suffix->size() < kBackwardDepth) {
+      GrowBackwardTracks<Grid>(search, newPtr, newDir, suffix,
+        backwardTracks);
+    }
+    suffix->erase(suffix->begin());
+    UndoSpace(&search->space, undoOffset);
+  }
+}
+
+// Grows the backward tracks from the end against the grid of a fresh attempt
+// and indexes them by the forward states they can be joined to: a forward
+// path can continue with a track if its last piece's successor list contains
+// the track's first piece.
+template <typename Grid>
+void BuildBackwardTracks(Search *search, BackwardTracks *backwardTracks) {
+  std::vector<piece_id_t> suffix;
+  GrowBackwardTracks<Grid>(search, kEndCoord, kEast, &suffix, backwardTracks);
+
+  std::vector<std::vector<uint32_t>> listsWithPiece(tables.numPieces);
+  for (int list = 0; list < tables.numSuccessorLists; ++list) {
+    for (int i = 0; i < tables.numSuccessors[list]; ++i) {
+      listsWithPiece[tables.successors[list][i]].push_back(list);
+    }
+  }
+
+  // Counting sort of (state, track) pairs into the offsets and ids.
+  std::vector<std::pair<uint32_t, uint32_t>> entries;
+  for (uint32_t id = 0; id < backwardTracks->tracks.size(); ++id) {
+    const BackwardTrack& track = backwardTracks->tracks[id];
+    piece_id_t first = backwardTracks->pieces[track.first];
+    for (uint32_t list : listsWithPiece[first]) {
+      entries.push_back(
+        {DistanceIndex<Grid>(track.ptr, track.dir, list), id});
+    }
+  }
+  backwardTracks->stateOffsets.assign(numClosingDistances + 1, 0);
+  for (const auto& [state, id] : entries) {
+    backwardTracks->stateOffsets[state + 1]++;
+  }
+  for (size_t i = 1; i < backwardTracks->stateOffsets.size(); ++i) {
+    backwardTracks->stateOffsets[i] += backwardTracks->stateOffsets[i - 1];
+  }
+  backwardTracks->trackIds.resize(entries.size());
+  std::vector<uint32_t> next(backwardTracks->stateOffsets.begin(),
+    backwardTracks->stateOffsets.end() - 1);
+  for (const auto& [state, id] : entries) {
+    backwardTracks->trackIds[next[state]++] = id;
+  }
+}
+
+// Tries to finish the coaster with a backward track that fits the top of the
+// stack, the grid and the length limits. On success the track's pieces are
+// pushed, otherwise the search is left as it was.
+template <typename Grid>
+bool JoinBackwardTrack(Search *search, const BackwardTracks& backwardTracks) {
+  const GeneratorInfo& lastInfo = search->stack.back();
+  piece_id_t lastPiece = tables.pieceIds[search->path.back().type];
+  int state = DistanceIndex<Grid>(lastInfo.ptr, lastInfo.dir,
+    tables.successorLists[lastPiece]);
+
+  size_t depth = search->stack.size();
+  size_t size = search->path.size();
+  const GeneratorOptions& options = *search->options;
+  for (uint32_t i = backwardTracks.stateOffsets[state];
+       i < backwardTracks.stateOffsets[state + 1]; ++i) {
+    const BackwardTrack& track =
+      backwardTracks.tracks[backwardTracks.trackIds[i]];
+    if (size + track.length <= options.minimumTrackSize
+        || size + track.length > options.maximumTrackSize) {
+      continue;
+    }
+
+    bool joined = true;
+    for (uint32_t j = 0; j < track.length && joined; ++j) {
+      piece_id_t piece = backwardTracks.pieces[track.first + j];
+      joined = AddTrackToStack<Grid>(search, {tables.types[piece], 4});
+    }
+    if (joined) {
+      return true;
+    }
+    if (search->stack.size() > depth) {
+      // Like in JoinConnector(), a boring rejection on a dropped frame means
+      // this one isn't proven dead.
+      for (size_t frame = depth; frame < search->stack.size(); ++frame) {
+        if (search->stack[frame].incomplete) {
+          search->stack[depth - 1].incomplete = true;
+        }
+      }
+      UndoSpace(&search->space, search->stack[depth].undoOffset);
+      search->stack.resize(depth);
+      search->path.resize(size);
+    }
+  }
+  return false;
+}
+
+// Packs the pose of a track's end relative to its start, and the states at
+// both: the successor list and direction it starts with, how far it goes and
+// the direction it ends facing. Offsets are within +-63 on every axis.
+uint32_t ConnectorKey(
+  int list,
+  int dirIn,
+  const Coord& offset,
+  int dirOut) {
+
+  return ((((static_cast<uint32_t>(list) * 4 + dirIn) * 128 + offset.y + 64)
+    * 128 + offset.x + 64) * 128 + offset.z + 64) * 4 + dirOut;
+}
+
+// Places a piece on the connector grid, like AddTrackToSpace() but without
+// touching the hash, which is only prepared for the search's grid.
+bool AddConnectorPiece(
+  Space *space,
+  const Coord& ptr,
+  DirectionType dir,
+  piece_id_t piece) {
+
+  const CompiledPiece& cp = tables.pieces[piece][dir];
+  if (OutOfBounds<ConnectorGrid>(AddCoords(ptr, cp.min))
+      || OutOfBounds<ConnectorGrid>(AddCoords(ptr, cp.max))) {
+    return false;
+  }
+  const SpaceRow *rows = &tables.shapeRows[cp.firstRow];
+  int bit = 4 * (ptr.x + cp.min.x);
+  int word = bit / 64;
+  int shift = bit % 64;
+  for (int pass = 0; pass < 2; ++pass) {
+    for (const SpaceRow *row = rows; row != rows + cp.numRows; ++row) {
+      int index =
+        RowIndex<ConnectorGrid>(ptr.y + row->y, ptr.z + row->z) + word;
+      uint64_t lo = static_cast<uint64_t>(row->mask) << shift;
+      uint64_t hi = (static_cast<uint64_t>(row->mask) >> 1) >> (63 - shift);
+      if (pass == 0 && ((space->words[index] & lo) != 0
+                        || (space->words[index + 1] & hi) != 0)) {
+        return false;
+      }
+      if (pass == 1) {
+        space->words[index] |= lo;
+        space->words[index + 1] |= hi;
+        space->undoLog.push_back({index, lo});
+        space->undoLog.push_back({index + 1, hi});
+      }
+    }
+  }
+  return true;
+}
+
+// Adds every connector that continues `steps`, which started in the state of
+// `key` and ends at `ptr` facing `dir`, with `list` to pick the next piece
+// from.
+void GrowConnectors(
+  Space *space,
+  uint32_t key,
+  const Coord& ptr,
+  DirectionType dir,
+  int list,
+  std::vector<uint8_t> *steps) {
+
+  for (int i = 0; i < tables.numSuccessors[list]; ++i) {
+    piece_id_t piece = tables.successors[list][i];
+    size_t undoOffset = space->undoLog.size();
+    if (!AddConnectorPiece(space, ptr, dir, piece)) {
+      continue;
+    }
+    Coord newPtr = AddCoords(ptr, tables.pieces[piece][dir].ptr);
+    DirectionType newDir =
+      static_cast<DirectionType>((dir + tables.turns[piece]) % 4);
+
+    steps->push_back(i);
+    Coord offset = {newPtr.y - kConnectorOrigin.y,
+      newPtr.x - kConnectorOrigin.x, newPtr.z - kConnectorOrigin.z};
+    builtConnectors.push_back(Connector{
+      .key = key + ConnectorKey(0, 0, offset, newDir),
+      .first = static_cast<uint32_t>(builtSteps.size()),
+      .length = static_cast<uint32_t>(steps->size())});
+    builtSteps.insert(builtSteps.end(), steps->begin(), steps->end());
+    int next = tables.successorLists[piece];
+    if (steps->size() < kConnectorDepth && next != 0) {
+      GrowConnectors(space, key, newPtr, newDir, next, steps);
+    }
+    steps->pop_back();
+    while (space->undoLog.size() > undoOffset) {
+      space->words[space->undoLog.back().index] ^= space->undoLog.back().bits;
+      space->undoLog.pop_back();
+    }
+  }
+}
+
+// Enumerates the connectors from every successor list and direction. Only the
+// first call does any work.
+void BuildConnectors() {
+  if (connectorLibrary.numConnectors != 0) {
+    return;
+  }
+
+  Space space;
+  space.words.resize(ConnectorGrid::numWords);
+  std::vector<uint8_t> steps;
+  for (int list = 1; list < tables.numSuccessorLists; ++list) {
+    for (DirectionType dir : {kNorth, kEast, kSouth, kWest}) {
+      // The key of the start state, the pose is added per connector.
+      uint32_t key = ConnectorKey(list, dir, {-64, -64, -64}, 0);
+      GrowConnectors(&space, key, kConnectorOrigin, dir, list, &steps);
+    }
+  }
+  std::stable_sort(builtConnectors.begin(), builtConnectors.end(),
+    [](const auto& a, const auto& b) {
+      return a.key < b.key;
+    });
+  connectorLibrary = {
+    .connectors = builtConnectors.data(),
+    .numConnectors = builtConnectors.size(),
+    .steps = builtSteps.data(),
+    .numSteps = builtSteps.size()};
+}
+
+// Tries to finish the coaster with a connector from the top of the stack to
+// the end, that fits the grid, the rest of the track and the length limits.
+// On success the connector's pieces are pushed, otherwise the search is left
+// as it was.
+template <typename Grid>
+bool JoinConnector(Search *search) {
+  const GeneratorInfo& lastInfo = search->stack.back();
+  int list = tables.successorLists[tables.pieceIds[search->path.back().type]];
+  if (ClosingDistance<Grid>(lastInfo.ptr, lastInfo.dir, list)
+      > kConnectorDepth) {
+    return false;
+  }
+  Coord offset = {kEndCoord.y - lastInfo.ptr.y, kEndCoord.x - lastInfo.ptr.x,
+    kEndCoord.z - lastInfo.ptr.z};
+  uint32_t key = ConnectorKey(list, lastInfo.dir, offset, kEast);
+  const Connector *end =
+    connectorLibrary.connectors + connectorLibrary.numConnectors;
+  const Connector *it = std::lower_bound(connectorLibrary.connectors, end, key,
+    [](const Connector& connector, uint32_t target) {
+      return connector.key < target;
+    });
+
+  size_t depth = search->stack.size();
+  size_t size = search->path.size();
+  const GeneratorOptions& options = *search->options;
+  for (; it != end && it->key == key; ++it) {
+    if (size + it->length <= options.minimumTrackSize
+        || size + it->length > options.maximumTrackSize) {
+      continue;
+    }
+
+    bool joined = true;
+    int next = list;
+    for (uint32_t j = 0; j < it->length && joined; ++j) {
+      int i = connectorLibrary.steps[it->first + j];
+      piece_id_t piece = tables.successors[next][i];
+      joined = (search->weights->enabled[next] & (1u << i)) != 0
+        && AddTrackToStack<Grid>(search, {tables.types[piece], 4});
+      next = tables.successorLists[piece];
+    }
+    if (joined) {
+      return true;
+    }
+    if (search->stack.size() > depth) {
+      // A boring rejection marks the connector frame it happened on, which
+      // is dropped here, but the rating depends on the path through this
+      // frame too, so it isn't proven dead either.
+      for (size_t frame = depth; frame < search->stack.size(); ++frame) {
+        if (search->stack[frame].incomplete) {
+          search->stack[depth - 1].incomplete = true;
+        }
+      }
+      UndoSpace(&search->space, search->stack[depth].undoOffset);
+      search->stack.resize(depth);
+      search->path.resize(size);
+    }
+  }
+  return false;
+}
+
+// Randomized DFS from the top of the stack that never backtracks past the
+// frame at `rootDepth - 1`, and stops after `budget` backtracks. On success the
+// coaster is left in `search->path`. With a `pool`, the budget is shared and
+// part of the work is donated whenever another worker is idle.
+template <typename Grid>
+SearchResult RunSearch(
+  Search *search,
+  size_t rootDepth,
+  int budget,
+  Portfolio *portfolio,
+  WorkPool *pool) {
+
+  std::vector<GeneratorInfo>& stack = search->stack;
+  std::vector<TrackDesignTrackElement>& path = search->path;
+
+  int steps = 0;
+  while (!portfolio->done.load(std::memory_order_relaxed)) {
+    if (pool != nullptr && pool->hungry.load(std::memory_order_relaxed) > 0) {
+      DonateWork(search, rootDepth, pool);
+    }
+
+    GeneratorInfo *lastInfo = &(stack[stack.size() - 1]);
+
+    // Check end condition.
+    if (lastInfo->ptr == kEndCoord && lastInfo->dir == kEast) {
+      // Has to contain at least one loop.
+      /*
+      if (std::find_if(path.begin(), path.end(), [](const auto& track) {
+          return track.type == TRACK_ELEM_LEFT_VERTICAL_LOOP 
+            || track.type == TRACK_ELEM_RIGHT_VERTICAL_LOOP; })
+          == path.end()) {
+        return kSearchExhausted;
+      }
+      */
+      return path.size() > search->options->minimumTrackSize
+        ? kSearchFound : kSearchExhausted;
+    }
+
+    // Close the coaster as soon as a backward track fits, once per frame.
+    if (portfolio->backwardTracks != nullptr && !lastInfo->closingTried) {
+      lastInfo->closingTried = true;
+      if (JoinBackwardTrack<Grid>(search, *portfolio->backwardTracks)) {
+        return kSearchFound;
+      }
+      lastInfo = &(stack[stack.size() - 1]);
+    }
+
+    // Or with a connector, once the coaster is long enough.
+    if (portfolio->connectors != nullptr && !lastInfo->connectorTried
+        && path.size() >= search->options->minimumTrackSize) {
+      lastInfo->connectorTried = true;
+      if (JoinConnector<Grid>(search)) {
+        return kSearchFound;
+      }
+      lastInfo = &(stack[stack.size() - 1]);
+      // The library has every track of up to kConnectorDepth pieces, so if
+      // the coaster can't be longer than that, no candidate can finish it.
+      if (path.size() + kConnectorDepth >= search->options->maximumTrackSize) {
+        lastInfo->failedTracks = 0xFFFF;
+      }
+    }
+
+    auto lastTrack = path.back();
+
+    // Debug(&stack);
+    if (ChooseTrack<Grid>(search, &(lastInfo->failedTracks),
+                          tables.pieceIds[lastTrack.type], rootDepth)) {
+      continue;
+    }
+
+    if (kProfile) {
+      search->stats.profile.exhausted[lastTrack.type]++;
+    }
+    if (stack.size() == rootDepth) {
+      return kSearchExhausted;
+    }
+
+    // Every candidate failed, so nothing can complete this state unless some
+    // were searched elsewhere or skipped.
+    if (!lastInfo->incomplete) {
+      AddDeadState(search, lastInfo->stateKey, lastInfo->energy);
+    }
+
+    search->stats.backtracks++;
+    if (kProfile) {
+      size_t depth = std::min<size_t>(path.size(), kProfileDepths - 1);
+      search->stats.profile.backtracksAtDepth[depth]++;
+    }
+    Backtrack(search, rootDepth);
+
+    steps = pool != nullptr ? ++pool->steps : steps + 1;
+    if (steps > budget) {
+      return kSearchStopped;
+    }
+    if ((search->stats.backtracks & (kDeadlineInterval - 1)) == 0
+        && PastDeadline(portfolio)) {
+      return kSearchStopped;
+    }
+  }
+  return kSearchStopped;
+}
+
+// Publishes the search's path as the result, unless another worker was first.
+void ClaimResult(Search *search, Portfolio *portfolio) {
+  bool expected = false;
+  if (portfolio->done.compare_exchange_strong(expected, true)) {
+    std::lock_guard<std::mutex> lock(portfolio->mutex);
+    portfolio->result.tracks = search->path;
+    portfolio->result.ratings =
+      EstimateRatings(search->stack.back().features);
+  }
+}
+
+// Ends the search, without a result unless one was already found, once the
+// time limit has passed.
+bool PastDeadline(Portfolio *portfolio) {
+  if (std::chrono::steady_clock::now() < portfolio->deadline) {
+    return false;
+  }
+  portfolio->done = true;
+  return true;
+}
+
+// Runs independent attempts until this or another worker finds a coaster.
+// Budgets follow the restart policy per worker. With partial restarts, an
+// attempt that ran out of steps continues from a checkpoint of the previous
+// one; only an exhausted search starts over from the initial track.
+template <typename Grid>
+void RunPortfolioWorker(Search *search, Portfolio *portfolio) {
+  const GeneratorOptions& options = *search->options;
+  size_t initialDepth = 0;
+  SearchResult result = kSearchExhausted;
+  for (int restart = 0; !portfolio->done; ++restart) {
+    if (PastDeadline(portfolio)) {
+      return;
+    }
+    int attempt = portfolio->attempts++;
+    if (options.verbose) {
+      std::lock_guard<std::mutex> lock(portfolio->mutex);
+      std::cout << "Generating, attempt " << attempt << "..." << std::endl;
+    }
+
+    if (options.partialRestarts && result == kSearchStopped) {
+      RewindToCheckpoint(search, initialDepth);
+    } else {
+      if (!StartAttempt<Grid>(search, portfolio)) {
+        return;
+      }
+      initialDepth = search->stack.size();
+    }
+    result = RunSearch<Grid>(search, initialDepth,
+      AttemptBudget(options, restart), portfolio, nullptr);
+    if (result == kSearchFound) {
+      ClaimResult(search, portfolio);
+    }
+  }
+}
+
+// Hands half of the untried candidates of the shallowest frame that has any
+// to the pool, leaving out track types disabled by their weight. Shallow frames hold the largest unexplored subtrees. The top
+// frame is skipped, its candidates are about to be tried anyway.
+void DonateWork(Search *search, size_t rootDepth, WorkPool *pool) {
+  std::vector<GeneratorInfo>& stack = search->stack;
+  const std::vector<TrackDesignTrackElement>& path = search->path;
+
+  for (size_t depth = rootDepth - 1; depth + 1 < stack.size(); ++depth) {
+    GeneratorInfo& info = stack[depth];
+    int list = tables.successorLists[tables.pieceIds[path[depth - 1].type]];
+    uint16_t untried = search->weights->enabled[list] & ~info.failedTracks
+      & ~(1u << SuccessorIndex(list, path[depth].type));
+    if (untried == 0) {
+      continue;
+    }
+
+    WorkItem item;
+    item.prefix.assign(path.begin(), path.begin() + depth);
+    int donated = (__builtin_popcount(untried) + 1) / 2;
+    for (int i = 0; donated > 0; ++i) {
+      if (untried & (1u << i)) {
+        item.candidates.push_back(tables.types[tables.successors[list][i]]);
+        info.failedTracks |= 1u << i;
+        donated--;
+      }
+    }
+    info.incomplete = true;
+
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    pool->items.push_back(std::move(item));
+    pool->cv.notify_one();
+    return;
+  }
+}
+
+// Blocks until there is work to take. Returns false once the attempt is over.
+bool TakeWork(WorkPool *pool, Portfolio *portfolio, WorkItem *item) {
+  std::unique_lock<std::mutex> lock(pool->mutex);
+  pool->idle++;
+  pool->hungry++;
+  while (true) {
+    if (pool->stopped || portfolio->done) {
+      break;
+    }
+    if (!pool->items.empty()) {
+      *item = std::move(pool->items.front());
+      pool->items.pop_front();
+      pool->idle--;
+      pool->hungry--;
+      return true;
+    }
+    if (pool->idle == pool->workers) {
+      // Nobody is left to donate, the whole tree has been searched.
+      pool->stopped = true;
+      pool->cv.notify_all();
+      break;
+    }
+    pool->cv.wait(lock);
+  }
+  pool->hungry--;
+  return false;
+}
+
+void StopPool(WorkPool *pool) {
+  std::lock_guard<std::mutex> lock(pool->mutex);
+  pool->stopped = true;
+  pool->cv.notify_all();
+}
+
+// Searches the part of the attempt's tree this worker is given. The `first`
+// worker starts at the root, the others take donated work from the pool and
+// rebuild the grid by replaying its prefix.
+template <typename Grid>
+void RunStealingWorker(
+  Search *search,
+  Portfolio *portfolio,
+  WorkPool *pool,
+  bool first) {
+
+  SearchResult result = kSearchExhausted;
+  if (first) {
+    if (!StartAttempt<Grid>(search, portfolio)) {
+      StopPool(pool);
+      return;
+    }
+    result = RunSearch<Grid>(search, search->stack.size(), pool->budget,
+      portfolio, pool);
+  }
+
+  WorkItem item;
+  while (result == kSearchExhausted && TakeWork(pool, portfolio, &item)) {
+    // Replaying the prefix can fail here, for example on a state this
+    // worker's own table of dead states already has. Nothing below it can
+    // close the circuit then, so the item is dropped.
+    ResetSearch<Grid>(search);
+    bool replayed = true;
+    for (const auto& track : item.prefix) {
+      if (!AddTrackToStack<Grid>(search, track)) {
+        replayed = false;
+        break;
+      }
+    }
+    if (!replayed) {
+      continue;
+    }
+
+    // Only the donated candidates are left to try at the root.
+    GeneratorInfo& root = search->stack.back();
+    int list = tables.successorLists[tables.pieceIds[item.prefix.back().type]];
+    root.failedTracks = (1u << tables.numSuccessors[list]) - 1;
+    for (track_type_t type : item.candidates) {
+      root.failedTracks &= ~(1u << SuccessorIndex(list, type));
+    }
+
+    result = RunSearch<Grid>(search, search->stack.size(), pool->budget,
+      portfolio, pool);
+  }
+
+  if (result == kSearchFound) {
+    ClaimResult(search, portfolio);
+  }
+  if (result != kSearchExhausted) {
+    StopPool(pool);
+  }
+}
+
+// Best when the station can still be reached by the middle of the allowed
+// lengths. Shorter detours don't count against a track, or the beam would
+// only keep the tracks hugging the station.
+template <typename Grid>
+float ClosingScore(const Search& search) {
+  const GeneratorInfo& info = search.stack.back();
+  piece_id_t piece = tables.pieceIds[search.path.back().type];
+  int distance =
+    ClosingDistance<Grid>(info.ptr, info.dir, tables.successorLists[piece]);
+  float target = (search.options->minimumTrackSize
+    + search.options->maximumTrackSize) / 2.0f;
+  return -std::max(0.0f, search.path.size() + distance - target);
+}
+
+float ExcitementScore(const Search& search) {
+  return EstimateRatings(search.stack.back().features).excitement;
+}
+
+float SpeedScore(const Search& search) {
+  return search.stack.back().energy;
+}
+
+template <typename Grid>
+constexpr ScoreFunction beamScores[kNumBeamScores] = {
+  &ClosingScore<Grid>,
+  &ExcitementScore,
+  &SpeedScore,
+};
+
+// Removes the last piece, which AddTrackToStack() placed.
+void PopTrack(Search *search) {
+  UndoSpace(&search->space, search->stack.back().undoOffset);
+  search->stack.pop_back();
+  search->path.pop_back();
+}
+
+// The state key with the exact energy mixed in, as a faster train has more
+// futures than a slower one.
+uint64_t BeamKey(const GeneratorInfo& info) {
+  uint32_t speed;
+  std::memcpy(&speed, &info.energy, sizeof(speed));
+  return MixKey(info.stateKey ^ speed);
+}
+
+// The widest beam whose nodes fit in the memory budget. Every level of the
+// beam adds `width` nodes, and the widest level has up to kMaxSuccessors
+// candidates per node.
+size_t BeamWidthLimit(const GeneratorOptions& options) {
+  size_t bytesPerTrack = options.maximumTrackSize * sizeof(BeamNode)
+    + kMaxSuccessors * sizeof(BeamCandidate) + sizeof(uint32_t);
+  return std::max<size_t>(1, options.beamMemory / bytesPerTrack);
+}
+
+// Moves the search to the track of `node`: the first `initialSize` pieces
+// of the path, which are the initial track, then the node's pieces. Only the
+// pieces after the part it shares with the current track are undone and
+// placed again. They all fit, they did when the nodes were made, so false
+// means the tables changed under the search.
+template <typename Grid>
+bool ReplayBeamNode(
+  Search *search,
+  const std::vector<BeamNode>& nodes,
+  uint32_t node,
+  size_t initialSize,
+  std::vector<track_type_t> *types) {
+
+  types->clear();
+  for (uint32_t i = node; i != kNoBeamNode; i = nodes[i].parent) {
+    types->push_back(nodes[i].type);
+  }
+  std::reverse(types->begin(), types->end());
+
+  const std::vector<TrackDesignTrackElement>& path = search->path;
+  size_t shared = 0;
+  while (shared < types->size() && initialSize + shared < path.size()
+         && path[initialSize + shared].type == (*types)[shared]) {
+    shared++;
+  }
+  while (path.size() > initialSize + shared) {
+    PopTrack(search);
+  }
+  for (size_t i = shared; i < types->size(); ++i) {
+    if (!AddTrackToStack<Grid>(search, {(*types)[i], 4})) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Grows the initial track one piece at a time, keeping the `width` best
+// tracks of every length, until one of them closes the circuit or none are
+// left. Of the tracks closing at the same length, the best scoring one wins.
+template <typename Grid>
+bool RunBeamSearch(Search *search, Portfolio *portfolio, size_t width) {
+  const GeneratorOptions& options = *search->options;
+  ScoreFunction score = beamScores<Grid>[options.beamScore];
+  std::vector<BeamNode> nodes;
+  nodes.reserve(width * options.maximumTrackSize);
+  std::vector<uint32_t> beam = {kNoBeamNode};
+  std::vector<BeamCandidate> candidates;
+  std::vector<track_type_t> types;
+  if (!StartAttempt<Grid>(search, portfolio)) {
+    return false;
+  }
+  size_t initialSize = search->path.size();
+
+  while (!beam.empty() && !PastDeadline(portfolio)
+         && !portfolio->done) {
+    candidates.clear();
+    bool closed = false;
+    BeamCandidate closing = {};
+    for (uint32_t node : beam) {
+      if (!ReplayBeamNode<Grid>(search, nodes, node, initialSize, &types)) {
+        return false;
+      }
+      piece_id_t last = tables.pieceIds[search->path.back().type];
+      int list = tables.successorLists[last];
+      uint16_t available = search->weights->enabled[list];
+      for (int i = 0; i < tables.numSuccessors[list]; ++i) {
+        track_type_t type = tables.types[tables.successors[list][i]];
+        if ((available & (1u << i)) == 0
+            || !AddTrackToStack<Grid>(search, {type, 4})) {
+          continue;
+        }
+        BeamCandidate candidate = {
+          .score = score(*search)
+            + RandomUnit(&search->random) * kBeamJitter,
+          .key = BeamKey(search->stack.back()),
+          .parent = node,
+          .type = type};
+        const GeneratorInfo& info = search->stack.back();
+        if (info.ptr == kEndCoord && info.dir == kEast) {
+          if (!closed || candidate.score > closing.score) {
+            closing = candidate;
+          }
+          closed = true;
+        } else {
+          candidates.push_back(candidate);
+        }
+        PopTrack(search);
+      }
+    }
+
+    if (closed) {
+      if (!ReplayBeamNode<Grid>(search, nodes, closing.parent, initialSize,
+                                &types)
+          || !AddTrackToStack<Grid>(search, {closing.type, 4})) {
+        return false;
+      }
+      ClaimResult(search, portfolio);
+      return true;
+    }
+
+    // Keeps the best of the tracks in the same state, then the best tracks
+    // with no more than kBeamChildren siblings.
+    std::sort(candidates.begin(), candidates.end(),
+      [](const auto& a, const auto& b) {
+        return a.key < b.key || (a.key == b.key && a.score > b.score);
+      });
+    candidates.erase(std::unique(candidates.begin(), candidates.end(),
+      [](const auto& a, const auto& b) {
+        return a.key == b.key;
+      }), candidates.end());
+    std::sort(candidates.begin(), candidates.end(),
+      [](const auto& a, const auto& b) {
+        return a.score > b.score;
+      });
+    std::unordered_map<uint32_t, int> children;
+    beam.clear();
+    for (const auto& candidate : candidates) {
+      if (beam.size() == width) {
+        break;
+      }
+      if (children[candidate.parent]++ < kBeamChildren) {
+        beam.push_back(nodes.size());
+        nodes.push_back({candidate.parent, candidate.type});
+      }
+    }
+    // Siblings, and then cousins, follow each other, so consecutive tracks
+    // share most of their pieces and replaying them is cheap.
+    std::stable_sort(beam.begin(), beam.end(),
+      [&nodes](uint32_t a, uint32_t b) {
+        return nodes[a].parent < nodes[b].parent;
+      });
+  }
+  return false;
+}
+
+// Runs beam searches until one closes a circuit, doubling the width after
+// every failure up to what fits in GeneratorOptions::beamMemory.
+template <typename Grid>
+void RunBeamWorker(Search *search, Portfolio *portfolio) {
+  const GeneratorOptions& options = *search->options;
+  size_t limit = BeamWidthLimit(options);
+  size_t width = std::min<size_t>(std::max(options.beamWidth, 1), limit);
+  while (!portfolio->done) {
+    int attempt = portfolio->attempts++;
+    if (options.verbose) {
+      std::cout << "Beam search of width " << width << ", attempt "
+        << attempt << "..." << std::endl;
+    }
+    if (RunBeamSearch<Grid>(search, portfolio, width)) {
+      return;
+    }
+    width = std::min(width * 2, limit);
+  }
+}
+
+float InversionScore(const Search& search) {
+  return search.stack.back().features.inversions;
+}
+
+// Share of the grid's tiles with a quarter of track on any level.
+template <typename Grid>
+float FootprintScore(const Search& search) {
+  const std::vector<uint64_t>& words = search.space.words;
+  int tiles = 0;
+  for (int y = 0; y < Grid::sizeY; ++y) {
+    for (int word = 0; word < Grid::wordsPerRow; ++word) {
+      uint64_t used = 0;
+      for (int z = 0; z < Grid::sizeZ; ++z) {
+        used |= words[RowIndex<Grid>(y, z) + word];
+      }
+      // Fold every tile's 4 bits into its lowest one.
+      used = (used | used >> 1 | used >> 2 | used >> 3) & 0x1111111111111111;
+      tiles += __builtin_popcountll(used);
+    }
+  }
+  return static_cast<float>(tiles) / (Grid::sizeY * Grid::sizeX);
+}
+
+template <typename Grid>
+constexpr ScoreFunction mctsRewards[kNumMctsRewards] = {
+  &ExcitementScore,
+  &InversionScore,
+  &FootprintScore<Grid>,
+};
+
+// Publishes the search's path as the result if it's the first coaster found,
+// or has a higher reward than the result.
+void OfferResult(Search *search, Portfolio *portfolio, float reward) {
+  std::lock_guard<std::mutex> lock(portfolio->mutex);
+  if (!portfolio->result.tracks.empty() && reward <= portfolio->resultReward) {
+    return;
+  }
+  portfolio->result.tracks = search->path;
+  portfolio->result.ratings = EstimateRatings(search->stack.back().features);
+  portfolio->resultReward = reward;
+  if (search->options->verbose) {
+    std::cout << "Found a coaster with a reward of " << reward << " after "
+      << portfolio->attempts << " rollouts" << std::endl;
+  }
+}
+
+// Walks down from the root to a node that has no children yet or closes the
+// circuit, taking the live child with the highest upper confidence bound at
+// every step, and adds a virtual loss to every node on the way. Children
+// without visits go first. Nodes whose children all died die as well. Returns
+// false once the root is dead.
+bool SelectMctsPath(
+  MctsTree *tree,
+  std::vector<uint32_t> *nodes,
+  std::vector<track_type_t> *types) {
+
+  std::lock_guard<std::mutex> lock(tree->mutex);
+  float scale = tree->bestReward > 0 ? tree->bestReward : 1;
+  nodes->clear();
+  types->clear();
+  uint32_t node = 0;
+  while (!tree->nodes[0].dead) {
+    MctsNode& current = tree->nodes[node];
+    nodes->push_back(node);
+    types->push_back(current.type);
+    if (!current.expanded || current.closed) {
+      for (uint32_t i : *nodes) {
+        tree->nodes[i].virtualLoss++;
+      }
+      return true;
+    }
+
+    double logVisits = std::log(current.visits + current.virtualLoss + 1);
+    double bestBound = -1;
+    uint32_t end = current.firstChild + current.numChildren;
+    for (uint32_t i = current.firstChild; i < end; ++i) {
+      const MctsNode& child = tree->nodes[i];
+      if (child.dead) {
+        continue;
+      }
+      double visits = child.visits + child.virtualLoss;
+      double bound = std::numeric_limits<double>::infinity();
+      if (visits > 0) {
+        bound = child.totalReward / scale / visits
+          + kMctsExploration * std::sqrt(logVisits / visits);
+      }
+      if (bound > bestBound) {
+        bestBound = bound;
+        node = i;
+      }
+    }
+    if (bestBound < 0) {
+      current.dead = true;
+      nodes->clear();
+      types->clear();
+      node = 0;
+    }
+  }
+  return false;
+}
+
+// Adds the children of the last of `nodes`, which is the track on top of the
+// search, unless another worker just did. Then places a random live child
+// and appends it to `nodes`, or nothing if the tree is full. Returns false if
+// there is nothing left to roll out from.
+template <typename Grid>
+bool ExpandMctsNode(
+  Search *search,
+  MctsTree *tree,
+  std::vector<uint32_t> *nodes) {
+
+  uint32_t node = nodes->back();
+  std::vector<track_type_t> fits;
+  piece_id_t last = tables.pieceIds[search->path.back().type];
+  int list = tables.successorLists[last];
+  uint16_t available = search->weights->enabled[list];
+  for (int i = 0; i < tables.numSuccessors[list]; ++i) {
+    track_type_t type = tables.types[tables.successors[list][i]];
+    if ((available & (1u << i)) != 0
+        && AddTrackToStack<Grid>(search, {type, 4})) {
+      fits.push_back(type);
+      PopTrack(search);
+    }
+  }
+
+  uint32_t child;
+  track_type_t type;
+  {
+    std::lock_guard<std::mutex> lock(tree->mutex);
+    std::vector<MctsNode>& treeNodes = tree->nodes;
+    if (!treeNodes[node].expanded) {
+      if (fits.empty()) {
+        treeNodes[node].dead = true;
+        return false;
+      }
+      if (treeNodes.size() + fits.size() > kMctsMaxNodes) {
+        return true;
+      }
+      treeNodes[node].firstChild = treeNodes.size();
+      treeNodes[node].numChildren = fits.size();
+      treeNodes[node].expanded = true;
+      for (track_type_t fit : fits) {
+        treeNodes.push_back(MctsNode{.parent = node, .type = fit});
+      }
+    }
+
+    std::vector<uint32_t> live;
+    uint32_t first = treeNodes[node].firstChild;
+    for (uint32_t i = first; i < first + treeNodes[node].numChildren; ++i) {
+      if (!treeNodes[i].dead) {
+        live.push_back(i);
+      }
+    }
+    if (live.empty()) {
+      treeNodes[node].dead = true;
+      return false;
+    }
+    child = live[RandomBelow(&search->random, live.size())];
+    treeNodes[child].virtualLoss++;
+    type = treeNodes[child].type;
+  }
+
+  nodes->push_back(child);
+  if (!AddTrackToStack<Grid>(search, {type, 4})) {
+    MarkMctsDead(tree, child);
+    return false;
+  }
+  return true;
+}
+
+void MarkMctsDead(MctsTree *tree, uint32_t node) {
+  std::lock_guard<std::mutex> lock(tree->mutex);
+  tree->nodes[node].dead = true;
+}
+
+// Counts the finished rollout on every node it went through, in place of its
+// virtual loss.
+void Backpropagate(
+  MctsTree *tree,
+  const std::vector<uint32_t>& nodes,
+  float reward) {
+
+  std::lock_guard<std::mutex> lock(tree->mutex);
+  for (uint32_t node : nodes) {
+    tree->nodes[node].virtualLoss--;
+    tree->nodes[node].visits++;
+    tree->nodes[node].totalReward += reward;
+  }
+  tree->bestReward = std::max(tree->bestReward, reward);
+}
+
+// Grows the shared tree until the deadline passes or every node is dead:
+// picks a leaf, replays its track, adds its children and rolls one of them
+// out with a short randomized depth-first search. Every coaster a rollout
+// closes is offered as the result, and its reward is backed up the tree.
+template <typename Grid>
+void RunMctsWorker(Search *search, Portfolio *portfolio, MctsTree *tree) {
+  ScoreFunction score = mctsRewards<Grid>[search->options->mctsReward];
+  std::vector<uint32_t> nodes;
+  std::vector<track_type_t> types;
+  while (!portfolio->done) {
+    if (std::chrono::steady_clock::now() >= tree->deadline
+        || !SelectMctsPath(tree, &nodes, &types)) {
+      portfolio->done = true;
+      return;
+    }
+    portfolio->attempts++;
+    if (!StartAttempt<Grid>(search, portfolio)) {
+      return;
+    }
+
+    // A piece that fit when its node was added is rejected later if a
+    // rollout of this worker proved its state dead.
+    size_t replayed = 1;
+    while (replayed < types.size()
+           && AddTrackToStack<Grid>(search, {types[replayed], 4})) {
+      replayed++;
+    }
+
+    float reward = 0;
+    const GeneratorInfo& info = search->stack.back();
+    if (replayed < types.size()) {
+      MarkMctsDead(tree, nodes[replayed]);
+    } else if (info.ptr == kEndCoord && info.dir == kEast) {
+      std::lock_guard<std::mutex> lock(tree->mutex);
+      tree->nodes[nodes.back()].closed = true;
+      reward = score(*search);
+    } else if (ExpandMctsNode<Grid>(search, tree, &nodes)) {
+      SearchResult result = RunSearch<Grid>(search, search->stack.size(),
+        kMctsRolloutBudget, portfolio, nullptr);
+      if (result == kSearchFound) {
+        reward = score(*search);
+        OfferResult(search, portfolio, reward);
+      } else if (result == kSearchExhausted
+                 && !search->stack.back().incomplete) {
+        MarkMctsDead(tree, nodes.back());
+      }
+    }
+    Backpropagate(tree, nodes, reward);
+  }
+}
+
+void AddStats(GeneratorStats *total, const GeneratorStats& stats) {
+  total->attempts += stats.attempts;
+  total->nodes += stats.nodes;
+  total->backtracks += stats.backtracks;
+  total->deadStateProbes += stats.deadStateProbes;
+  total->deadStateHits += stats.deadStateHits;
+  total->deadStateStores += stats.deadStateStores;
+  total->backjumps += stats.backjumps;
+  total->jumpedFrames += stats.jumpedFrames;
+  if (!kProfile) {
+    return;
+  }
+
+  SearchProfile& profile = total->profile;
+  for (int type = 0; type < kProfileTrackTypes; ++type) {
+    for (int reason = 0; reason < kNumRejectReasons; ++reason) {
+      profile.rejections[type][reason] +=
+        stats.profile.rejections[type][reason];
+    }
+    profile.exhausted[type] += stats.profile.exhausted[type];
+  }
+  for (int depth = 0; depth < kProfileDepths; ++depth) {
+    profile.backtracksAtDepth[depth] += stats.profile.backtracksAtDepth[depth];
+  }
+  profile.prepareSeconds += stats.profile.prepareSeconds;
+  profile.backwardSeconds += stats.profile.backwardSeconds;
+  profile.searchSeconds += stats.profile.searchSeconds;
+}
+
+// Generate() on one grid type.
+template <typename Grid>
+GeneratorResult GenerateOnGrid(
+  const GeneratorOptions& options,
+  GeneratorStats *stats) {
+
+  *stats = {};
+  auto start = std::chrono::steady_clock::now();
+
+  // The station and the reserved tiles before it have to fit.
+  if (OutOfBounds<Grid>(kStartCoord)
+      || OutOfBounds<Grid>({kEndCoord.y, kEndCoord.x, kEndCoord.z + 1})) {
+    std::cout << "Grid too small" << std::endl;
+    return {};
+  }
+  PrepareTables<Grid>(options);
+  TrackWeights weights;
+  CompileTrackWeights(options, &weights);
+
+  int threads = options.threads;
+  if (threads <= 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  Portfolio portfolio;
+  portfolio.done = false;
+  portfolio.attempts = 0;
+  portfolio.resultReward = 0;
+  portfolio.backwardTracks = nullptr;
+  portfolio.connectors = nullptr;
+  portfolio.deadline = std::chrono::steady_clock::time_point::max();
+  if (options.timeLimit > 0) {
+    portfolio.deadline = start + std::chrono::duration_cast<
+      std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(options.timeLimit));
+  }
+  if (options.closingConnectors) {
+    BuildConnectors();
+    portfolio.connectors = &connectorLibrary;
+  }
+
+  // Allocate space once per worker, every attempt starts from an empty grid.
+  // The extra word pads the last row for AddTrackToSpace. Station pieces are
+  // placed without checking the length, so the stack can be a few frames
+  // deeper than the maximum. With the frames reserved up front, the search
+  // doesn't allocate anything per piece.
+  size_t frames = options.maximumTrackSize + 8;
+  std::vector<Search> searches(threads);
+  for (int i = 0; i < threads; ++i) {
+    searches[i].options = &options;
+    searches[i].space.words.resize(Grid::numWords);
+    searches[i].space.undoLog.reserve(frames * kUndoEntriesPerFrame);
+    searches[i].stack.reserve(frames);
+    searches[i].path.reserve(frames);
+    searches[i].weights = &weights;
+    SeedRandom(&searches[i].random, options.seed + i);
+    // Energies are never negative, so empty slots match no state.
+    searches[i].deadStates.resize(kDeadStateTableSize, DeadState{0, -1});
+    if (options.backjumping) {
+      searches[i].conflictWords = frames / 64 + 1;
+      searches[i].conflicts.resize(frames * searches[i].conflictWords);
+      searches[i].space.owners.resize(Grid::numWords * 64);
+    }
+    searches[i].stats = {};
+  }
+
+  // The initial track is the same in every attempt, so the backward tracks
+  // are grown once against it.
+  auto prepared = std::chrono::steady_clock::now();
+  BackwardTracks backwardTracks;
+  if (options.bidirectional && options.engine == kEngineDepthFirst) {
+    if (!StartAttempt<Grid>(&searches[0], &portfolio)) {
+      return {};
+    }
+    BuildBackwardTracks<Grid>(&searches[0], &backwardTracks);
+    portfolio.backwardTracks = &backwardTracks;
+    if (options.verbose) {
+      std::cout << "Grew " << backwardTracks.tracks.size()
+        << " backward tracks" << std::endl;
+    }
+  }
+
+  auto backwardGrown = std::chrono::steady_clock::now();
+  if (options.engine == kEngineBeam) {
+    RunBeamWorker<Grid>(&searches[0], &portfolio);
+  } else if (options.engine == kEngineMcts) {
+    MctsTree tree;
+    tree.nodes.push_back(MctsNode{});
+    tree.bestReward = 0;
+    tree.deadline = std::min(portfolio.deadline,
+      backwardGrown + std::chrono::duration_cast<
+        std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(options.mctsSeconds)));
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threads; ++i) {
+      workers.emplace_back(RunMctsWorker<Grid>, &searches[i], &portfolio,
+        &tree);
+    }
+    RunMctsWorker<Grid>(&searches[0], &portfolio, &tree);
+    for (auto& worker : workers) {
+      worker.join();
+    }
+  } else if (options.parallelMode == kPortfolio) {
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threads; ++i) {
+      workers.emplace_back(RunPortfolioWorker<Grid>, &searches[i],
+        &portfolio);
+    }
+    RunPortfolioWorker<Grid>(&searches[0], &portfolio);
+    for (auto& worker : workers) {
+      worker.join();
+    }
+  }
+
+  while (options.engine == kEngineDepthFirst
+         && options.parallelMode == kWorkStealing && !portfolio.done) {
+    int attempt = portfolio.attempts++;
+    if (options.verbose) {
+      std::cout << "Generating, attempt " << attempt << "..." << std::endl;
+    }
+
+    WorkPool pool;
+    pool.hungry = 0;
+    pool.steps = 0;
+    pool.budget = AttemptBudget(options, attempt);
+    pool.workers = threads;
+    pool.idle = 0;
+    pool.stopped = false;
+
+    std::vector<std::thread> workers;
+    for (int i = 1; i < threads; ++i) {
+      workers.emplace_back(RunStealingWorker<Grid>, &searches[i], &portfolio,
+        &pool, false);
+    }
+    RunStealingWorker<Grid>(&searches[0], &portfolio, &pool, true);
+    for (auto& worker : workers) {
+      worker.join();
+    }
+  }
+
+  for (const Search& search : searches) {
+    AddStats(stats, search.stats);
+  }
+  stats->attempts = portfolio.attempts;
+  if (kProfile) {
+    auto end = std::chrono::steady_clock::now();
+    std::chrono::duration<double> prepare = prepared - start;
+    std::chrono::duration<double> backward = backwardGrown - prepared;
+    std::chrono::duration<double> search = end - backwardGrown;
+    stats->profile.prepareSeconds = prepare.count();
+    stats->profile.backwardSeconds = backward.count();
+    stats->profile.searchSeconds = search.count();
+  }
+  return portfolio.result;
+}
+
+// Picks the engine compiled for the requested grid size, or the dynamic one
+// for sizes that don't have their own.
+GeneratorResult Generate(
+  const GeneratorOptions& options,
+  GeneratorStats *stats) {
+
+  if (options.sizeY > kMaxGridSize || options.sizeX > kMaxGridSize
+      || options.sizeZ > kMaxGridSize) {
+    std::cout << "Grid too large" << std::endl;
+    return {};
+  }
+  if (options.maximumTrackSize > kMaxTrackSize) {
+    std::cout << "Track too long" << std::endl;
+    return {};
+  }
+
+  Coord size = {options.sizeY, options.sizeX, options.sizeZ};
+  if (size == Coord{kSizeY, kSizeX, kSizeZ}) {
+    using DefaultGrid = FixedGrid<kSizeY, kSizeX, kSizeZ>;
+    return GenerateOnGrid<DefaultGrid>(options, stats);
+  }
+  if (size == Coord{16, 16, 16}) {
+    return GenerateOnGrid<FixedGrid<16, 16, 16>>(options, stats);
+  }
+  if (size == Coord{24, 24, 16}) {
+    return GenerateOnGrid<FixedGrid<24, 24, 16>>(options, stats);
+  }
+  if (size == Coord{32, 32, 24}) {
+    return GenerateOnGrid<FixedGrid<32, 32, 24>>(options, stats);
+  }
+
+  DynamicGrid::sizeY = options.sizeY;
+  DynamicGrid::sizeX = options.sizeX;
+  DynamicGrid::sizeZ = options.sizeZ;
+  DynamicGrid::wordsPerRow = (options.sizeX * 4 + 63) / 64;
+  DynamicGrid::numWords =
+    DynamicGrid::wordsPerRow * options.sizeY * options.sizeZ + 1;
+  return GenerateOnGrid<DynamicGrid>(options, stats);
+}
+
+void WriteStatsJson(const GeneratorStats& stats, std::ostream *out) {
+  static const char *reasonNames[kNumRejectReasons] = {
+    "pointerOutOfBounds",
+    "shapeOutOfBounds",
+    "collision",
+    "unreachable",
+    "tooLong",
+    "tooEarly",
+    "tooSlow",
+    "boring",
+    "deadState",
+  };
+  const SearchProfile& profile = stats.profile;
+
+  *out << "{\"attempts\": " << stats.attempts
+    << ", \"nodes\": " << stats.nodes
+    << ", \"backtracks\": " << stats.backtracks
+    << ", \"deadStateProbes\": " << stats.deadStateProbes
+    << ", \"deadStateHits\": " << stats.deadStateHits
+    << ", \"deadStateStores\": " << stats.deadStateStores
+    << ", \"backjumps\": " << stats.backjumps
+    << ", \"jumpedFrames\": " << stats.jumpedFrames;
+  if (!kProfile) {
+    *out << "}";
+    return;
+  }
+
+  // Track types that were never rejected or exhausted are left out.
+  *out << ", \"trackTypes\": {";
+  const char *separator = "";
+  for (int type = 0; type < kProfileTrackTypes; ++type) {
+    const uint64_t *rejections = profile.rejections[type];
+    if (profile.exhausted[type] == 0
+        && std::all_of(rejections, rejections + kNumRejectReasons,
+                       [](uint64_t count) { return count == 0; })) {
+      continue;
+    }
+    *out << separator << "\"" << type << "\": {\"exhausted\": "
+      << profile.exhausted[type];
+    for (int reason = 0; reason < kNumRejectReasons; ++reason) {
+      *out << ", \"" << reasonNames[reason] << "\": " << rejections[reason];
+    }
+    *out << "}";
+    separator = ", ";
+  }
+
+  // Trailing depths without backtracks are left out.
+  int depths = kProfileDepths;
+  while (depths > 0 && profile.backtracksAtDepth[depths - 1] == 0) {
+    depths--;
+  }
+  *out << "}, \"backtracksAtDepth\": [";
+  for (int depth = 0; depth < depths; ++depth) {
+    *out << (depth == 0 ? "" : ", ") << profile.backtracksAtDepth[depth];
+  }
+  *out << "], \"prepareSeconds\": " << profile.prepareSeconds
+    << ", \"backwardSeconds\": " << profile.backwardSeconds
+    << ", \"searchSeconds\": " << profile.searchSeconds << "}";
+}
@@ -0,0 +1,248 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <openrct2/ride/TrackDesign.h>
+
+/*
+ * Constants
+ */
+
+// Defaults of the grid size and track length.
+constexpr int kSizeY = 9;
+constexpr int kSizeX = 12;
+constexpr int kSizeZ = 11;
+constexpr int kMinimumTrackSize = 100;
+constexpr int kMaximumTrackSize = 160;
+// Largest grid size along any axis and longest track Generate() accepts. The
+// closing distances of every state of the grid are kept in a table, with one
+// byte per distance.
+constexpr int kMaxGridSize = 64;
+constexpr int kMaxTrackSize = 254;
+// Default budget of an attempt, scaled by the restart policy, see
+// RestartPolicy.
+constexpr int kTryPerAttempt = 2000;
+// The train has to keep enough speed to climb this many more levels, so the
+// coaster doesn't stall. See GeneratorOptions::minimumClimb.
+constexpr float kMinimumClimb = 1;
+
+// Build with -DGENERATOR_STATS to fill in GeneratorStats::profile. It costs a
+// few percent, so it's compiled out by default.
+#ifdef GENERATOR_STATS
+constexpr bool kProfile = true;
+#else
+constexpr bool kProfile = false;
+#endif
+
+// Sizes of the profile's tables. Deeper backtracks are counted in the last
+// bucket of the histogram.
+constexpr int kProfileTrackTypes = 256;
+constexpr int kProfileDepths = 256;
+
+/*
+ * Types
+ */
+
+// How parallel workers share the search.
+enum ParallelMode {
+  // Every worker runs its own independent attempts.
+  kPortfolio,
+  // All workers split the search tree of one attempt between them.
+  kWorkStealing,
+};
+
+// How the step budget of consecutive attempts grows. Each attempt gets
+// GeneratorOptions::tryPerAttempt times:
+enum RestartPolicy {
+  // 1, every time.
+  kRestartFixed,
+  // The Luby sequence 1, 1, 2, 1, 1, 2, 4, 1, ..., which keeps short attempts
+  // coming while the long ones grow without bound.
+  kRestartLuby,
+  // kRestartGrowth to the power of the attempt index.
+  kRestartGeometric,
+};
+
+// Estimated like the game's ride ratings, see EstimateRatings().
+struct RideRatings {
+  float excitement;
+  float intensity;
+  float nausea;
+};
+
+// How the coaster is searched for.
+enum SearchEngine {
+  // Randomized depth-first search with restarts.
+  kEngineDepthFirst,
+  // Keeps the beamWidth best partial tracks of every length.
+  kEngineBeam,
+  // Monte Carlo tree search for the coaster with the highest mctsReward.
+  kEngineMcts,
+};
+
+// What the beam search prefers.
+enum BeamScore {
+  // Tracks that can get back to the station in about the pieces left.
+  kScoreClosing,
+  // The highest estimated excitement so far.
+  kScoreExcitement,
+  // The most speed left, see GeneratorOptions::minimumClimb.
+  kScoreSpeed,
+  kNumBeamScores,
+};
+
+// What the Monte Carlo tree search maximizes, over complete coasters.
+enum MctsReward {
+  // The estimated excitement rating.
+  kRewardExcitement,
+  // The number of vertical loops.
+  kRewardInversions,
+  // The share of the grid's tiles that have track on any level.
+  kRewardFootprint,
+  kNumMctsRewards,
+};
+
+// Fields left out of an initializer get the defaults of the constants above.
+struct GeneratorOptions {
+  int sizeY = kSizeY;
+  int sizeX = kSizeX;
+  int sizeZ = kSizeZ;
+  // The coaster has more than minimumTrackSize pieces and at most
+  // maximumTrackSize.
+  size_t minimumTrackSize = kMinimumTrackSize;
+  size_t maximumTrackSize = kMaximumTrackSize;
+  // Backtracks before an attempt is given up, scaled by restartPolicy.
+  int tryPerAttempt = kTryPerAttempt;
+  RestartPolicy restartPolicy = kRestartLuby;
+  // When an attempt runs out of steps, rewind to a random frame in the
+  // shallowest part of the track instead of starting over with the initial
+  // track. Only used by kPortfolio.
+  bool partialRestarts = false;
+  // On a dead end, backtrack straight to the deepest of the pieces the
+  // rejected ones collided with, instead of one piece at a time.
+  bool backjumping = false;
+  // Prune tracks where the train, by a rough energy model, wouldn't keep
+  // enough speed to climb this many more levels of the grid. 0 disables it.
+  float minimumClimb = kMinimumClimb;
+  // Closing the circuit is only allowed if the estimated excitement is at
+  // least this much. 0 accepts any coaster.
+  float minimumExcitement = 0;
+  // Give up after this many seconds and return no coaster. 0 searches until
+  // one is found. kEngineMcts stops at whichever of this and mctsSeconds
+  // comes first.
+  double timeLimit = 0;
+  // Number of parallel workers, 0 uses every core.
+  int threads = 0;
+  // Workers seed their RNG with seed + their index.
+  uint32_t seed = 0;
+  ParallelMode parallelMode = kPortfolio;
+  // Also grow tracks backwards from the end, and close the circuit as soon as
+  // the forward search meets one of them. Only used by kEngineDepthFirst.
+  bool bidirectional = false;
+  // Once the coaster is long enough, close the circuit with a few pieces from
+  // a library of short tracks between relative poses whenever they fit,
+  // instead of searching for them.
+  bool closingConnectors = false;
+  SearchEngine engine = kEngineDepthFirst;
+  // Partial tracks kept per length by kEngineBeam. It runs on one thread, and
+  // doubles the width after every failed attempt, as long as the tracks fit
+  // in beamMemory bytes.
+  int beamWidth = 1;
+  size_t beamMemory = 256 << 20;
+  BeamScore beamScore = kScoreClosing;
+  // kEngineMcts searches on every thread until mctsSeconds have passed, then
+  // returns the best coaster found, if any.
+  double mctsSeconds = 0;
+  MctsReward mctsReward = kRewardExcitement;
+  // Directory of the table cache: the compiled pieces, the closing distances
+  // of the grid and the connector library, mapped from a file that's built by
+  // the first run and shared by every later one. Empty builds them in memory.
+  std::string tableCache = {};
+  // Print every attempt.
+  bool verbose = false;
+  // Relative odds of picking each track type while the coaster is shorter
+  // than minimumTrackSize. Types not listed weigh 1, except vertical loops
+  // which are preferred. A weight of 0 never uses the type.
+  std::map<track_type_t, float> trackWeights = {};
+};
+
+// Why AddTrackToStack() turned a piece down.
+enum RejectReason {
+  // The piece would end outside the grid.
+  kRejectPointerOutOfBounds,
+  // Part of the piece would be outside the grid.
+  kRejectShapeOutOfBounds,
+  // The piece overlaps the track.
+  kRejectCollision,
+  // The end can't be reached from where the piece ends.
+  kRejectUnreachable,
+  // The end is too far for the remaining budget of pieces.
+  kRejectTooLong,
+  // The piece reaches the end before the minimum length.
+  kRejectTooEarly,
+  // The train would be too slow to make it over the piece.
+  kRejectTooSlow,
+  // The piece would close a coaster below minimumExcitement.
+  kRejectBoring,
+  // The state after the piece is known to be dead.
+  kRejectDeadState,
+  kNumRejectReasons,
+};
+
+// Where the search spends its effort, only filled in with kProfile.
+struct SearchProfile {
+  // Rejected pieces per track type and reason.
+  uint64_t rejections[kProfileTrackTypes][kNumRejectReasons];
+  // Frames that ran out of candidates, per track type of their last piece.
+  uint64_t exhausted[kProfileTrackTypes];
+  // Backtracks per path length.
+  uint64_t backtracksAtDepth[kProfileDepths];
+  // Time spent compiling the tables, growing the backward tracks and
+  // searching.
+  double prepareSeconds;
+  double backwardSeconds;
+  double searchSeconds;
+};
+
+// Counters of one Generate() call, summed over every worker.
+struct GeneratorStats {
+  int attempts;
+  // Pieces placed and removed by the search.
+  uint64_t nodes;
+  uint64_t backtracks;
+  // Lookups of the table of dead states. Every hit skips a whole subtree the
+  // search already proved dead.
+  uint64_t deadStateProbes;
+  uint64_t deadStateHits;
+  uint64_t deadStateStores;
+  // Backtracks that skipped frames, and how many they skipped in total.
+  uint64_t backjumps;
+  uint64_t jumpedFrames;
+  SearchProfile profile;
+};
+
+// A generated coaster, empty if none was found.
+struct GeneratorResult {
+  std::vector<TrackDesignTrackElement> tracks;
+  RideRatings ratings;
+};
+
+/*
+ * Declarations
+ */
+
+// Runs the search on `options.threads` workers and returns the first coaster
+// found, or nothing if the initial track doesn't fit or the grid or the track
+// length is over kMaxGridSize or kMaxTrackSize.
+GeneratorResult Generate(
+  const GeneratorOptions& options,
+  GeneratorStats *stats);
+
+// Writes the counters, and the profile with kProfile, as a JSON object on a
+// single line.
+void WriteStatsJson(const GeneratorStats& stats, std::ostream *out);
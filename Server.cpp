@@ -0,0 +1,551 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "Server.h"
+
+/*
+ * Constants
+ */
+
+// mkstemps() template of the coasters saved for requests without "bytes".
+// Every one gets a new file no other process could have guessed.
+constexpr char kServeTrackToSave[] =
+  "/tmp/serve_XXXXXX.td6";
+constexpr int kServeTrackSuffix = 4;
+// Longer request lines are turned down.
+constexpr size_t kMaxRequestSize = 1 << 16;
+constexpr size_t kReadBufferSize = 4096;
+// Seconds a request may search for at most, also the deadline of requests
+// without one.
+constexpr double kMaxRequestDeadline = 60;
+
+/*
+ * Types
+ */
+
+// A request after parsing. Fields it left out keep the server's defaults.
+struct ServeRequest {
+  // Echoed back as is, so the client can match responses to requests.
+  std::string id;
+  GeneratorOptions options;
+  // Send the TD6 file back in base64 instead of saving it.
+  bool bytes;
+};
+
+// Reads a single line of JSON, see ParseRequest().
+struct JsonReader {
+  const std::string& text;
+  size_t pos;
+};
+
+/*
+ * Declarations
+ */
+
+void SkipSpace(JsonReader *reader);
+bool ReadChar(JsonReader *reader, char c);
+bool ReadString(JsonReader *reader, std::string *value);
+bool ReadNumber(JsonReader *reader, double *value);
+bool ReadNumbers(JsonReader *reader, double *values, int count);
+bool ReadBool(JsonReader *reader, bool *value);
+bool ReadScalar(JsonReader *reader, std::string *raw);
+bool ParseRequest(
+  const std::string& line,
+  const GeneratorOptions& defaults,
+  ServeRequest *request,
+  std::string *error);
+void WriteJsonString(const std::string& value, std::ostream *out);
+std::string Base64(const std::vector<uint8_t>& data);
+bool SaveServedTrack(const Td6& td6, std::string *path);
+std::string HandleRequest(
+  const std::string& line,
+  const GeneratorOptions& defaults,
+  Td6 *td6);
+int ServeStream(const GeneratorOptions& defaults, Td6 *td6);
+bool WriteAll(int fd, const std::string& data);
+void ServeConnection(int fd, const GeneratorOptions& defaults, Td6 *td6);
+int ServeSocket(
+  const GeneratorOptions& defaults,
+  Td6 *td6,
+  const std::string& socketPath);
+
+/*
+ * Definitions
+ */
+
+void SkipSpace(JsonReader *reader) {
+  const std::string& text = reader->text;
+  while (reader->pos < text.size()
+         && (text[reader->pos] == ' ' || text[reader->pos] == '\t'
+             || text[reader->pos] == '\r' || text[reader->pos] == '\n')) {
+    reader->pos++;
+  }
+}
+
+bool ReadChar(JsonReader *reader, char c) {
+  SkipSpace(reader);
+  if (reader->pos < reader->text.size() && reader->text[reader->pos] == c) {
+    reader->pos++;
+    return true;
+  }
+  return false;
+}
+
+// Only the escapes of ASCII characters are understood, which is all an id
+// needs.
+bool ReadString(JsonReader *reader, std::string *value) {
+  const std::string& text = reader->text;
+  if (!ReadChar(reader, '"')) {
+    return false;
+  }
+  value->clear();
+  while (reader->pos < text.size()) {
+    char c = text[reader->pos++];
+    if (c == '"') {
+      return true;
+    }
+    if (c != '\\') {
+      value->push_back(c);
+      continue;
+    }
+    if (reader->pos >= text.size()) {
+      return false;
+    }
+    c = text[reader->pos++];
+    switch (c) {
+      case 'n':
+        value->push_back('\n');
+        break;
+      case 't':
+        value->push_back('\t');
+        break;
+      case 'r':
+        value->push_back('\r');
+        break;
+      case '"':
+      case '\\':
+      case '/':
+        value->push_back(c);
+        break;
+      default:
+        return false;
+    }
+  }
+  return false;
+}
+
+// Only JSON's number syntax is accepted, not everything strtod() takes, like
+// nan, inf or hex, and numbers too large for a double are turned down.
+bool ReadNumber(JsonReader *reader, double *value) {
+  SkipSpace(reader);
+  const std::string& text = reader->text;
+  size_t pos = reader->pos;
+  auto digits = [&text, &pos]() {
+    size_t begin = pos;
+    while (pos < text.size() && text[pos] >= '0' && text[pos] <= '9') {
+      pos++;
+    }
+    return pos - begin;
+  };
+  if (pos < text.size() && text[pos] == '-') {
+    pos++;
+  }
+  size_t integer = digits();
+  if (integer == 0 || (integer > 1 && text[pos - integer] == '0')) {
+    return false;
+  }
+  if (pos < text.size() && text[pos] == '.') {
+    pos++;
+    if (digits() == 0) {
+      return false;
+    }
+  }
+  if (pos < text.size() && (text[pos] == 'e' || text[pos] == 'E')) {
+    pos++;
+    if (pos < text.size() && (text[pos] == '+' || text[pos] == '-')) {
+      pos++;
+    }
+    if (digits() == 0) {
+      return false;
+    }
+  }
+
+  *value = std::strtod(text.substr(reader->pos, pos - reader->pos).c_str(),
+    nullptr);
+  if (!std::isfinite(*value)) {
+    return false;
+  }
+  reader->pos = pos;
+  return true;
+}
+
+// An array of exactly `count` numbers.
+bool ReadNumbers(JsonReader *reader, double *values, int count) {
+  if (!ReadChar(reader, '[')) {
+    return false;
+  }
+  for (int i = 0; i < count; ++i) {
+    if ((i > 0 && !ReadChar(reader, ',')) || !ReadNumber(reader, &values[i])) {
+      return false;
+    }
+  }
+  return ReadChar(reader, ']');
+}
+
+bool ReadBool(JsonReader *reader, bool *value) {
+  SkipSpace(reader);
+  for (bool b : {true, false}) {
+    const char *word = b ? "true" : "false";
+    if (reader->text.compare(reader->pos, std::strlen(word), word) == 0) {
+      reader->pos += std::strlen(word);
+      *value = b;
+      return true;
+    }
+  }
+  return false;
+}
+
+// A string, number, boolean or null, kept as its JSON text.
+bool ReadScalar(JsonReader *reader, std::string *raw) {
+  SkipSpace(reader);
+  size_t begin = reader->pos;
+  std::string string;
+  double number;
+  bool boolean;
+  if (!ReadString(reader, &string) && !ReadNumber(reader, &number)
+      && !ReadBool(reader, &boolean)) {
+    if (reader->text.compare(reader->pos, 4, "null") != 0) {
+      return false;
+    }
+    reader->pos += 4;
+  }
+  *raw = reader->text.substr(begin, reader->pos - begin);
+  return true;
+}
+
+// Requests are flat objects:
+//   {"id": 7, "size": [16, 16, 16], "length": [100, 160], "seed": 42,
+//    "deadline": 2.5, "minExcitement": 6, "bytes": false}
+// All fields are optional, unknown ones are an error. Every request gets a
+// deadline of at most kMaxRequestDeadline.
+bool ParseRequest(
+  const std::string& line,
+  const GeneratorOptions& defaults,
+  ServeRequest *request,
+  std::string *error) {
+
+  GeneratorOptions& options = request->options;
+  options = defaults;
+  request->id = "null";
+  request->bytes = false;
+
+  JsonReader reader = {line, 0};
+  if (!ReadChar(&reader, '{')) {
+    *error = "expected an object";
+    return false;
+  }
+  bool first = true;
+  while (!ReadChar(&reader, '}')) {
+    std::string key;
+    if ((!first && !ReadChar(&reader, ',')) || !ReadString(&reader, &key)
+        || !ReadChar(&reader, ':')) {
+      *error = "malformed object";
+      return false;
+    }
+    first = false;
+
+    // Numbers are bounded so they convert to the option types.
+    double values[3] = {};
+    bool valid;
+    if (key == "id") {
+      valid = ReadScalar(&reader, &request->id);
+    } else if (key == "size") {
+      valid = ReadNumbers(&reader, values, 3);
+      for (double value : values) {
+        valid = valid && value >= 1 && value <= kMaxGridSize;
+      }
+      options.sizeY = valid ? values[0] : 0;
+      options.sizeX = valid ? values[1] : 0;
+      options.sizeZ = valid ? values[2] : 0;
+    } else if (key == "length") {
+      valid = ReadNumbers(&reader, values, 2) && values[0] >= 0
+        && values[1] > values[0] && values[1] <= kMaxTrackSize;
+      options.minimumTrackSize = valid ? values[0] : 0;
+      options.maximumTrackSize = valid ? values[1] : 0;
+    } else if (key == "seed") {
+      valid = ReadNumber(&reader, values) && values[0] >= 0
+        && values[0] <= UINT32_MAX;
+      options.seed = valid ? values[0] : 0;
+    } else if (key == "deadline") {
+      valid = ReadNumber(&reader, &options.timeLimit)
+        && options.timeLimit > 0 && options.timeLimit <= kMaxRequestDeadline;
+    } else if (key == "minExcitement") {
+      valid = ReadNumber(&reader, values) && values[0] >= 0;
+      options.minimumExcitement = values[0];
+    } else if (key == "bytes") {
+      valid = ReadBool(&reader, &request->bytes);
+    } else {
+      *error = "unknown field " + key;
+      return false;
+    }
+    if (!valid) {
+      *error = "invalid " + key;
+      return false;
+    }
+  }
+  SkipSpace(&reader);
+  if (reader.pos != line.size()) {
+    *error = "trailing characters";
+    return false;
+  }
+  if (options.timeLimit <= 0 || options.timeLimit > kMaxRequestDeadline) {
+    options.timeLimit = kMaxRequestDeadline;
+  }
+  return true;
+}
+
+void WriteJsonString(const std::string& value, std::ostream *out) {
+  *out << '"';
+  for (char c : value) {
+    if (c == '"' || c == '\\') {
+      *out << '\\' << c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char escaped[8];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      *out << escaped;
+    } else {
+      *out << c;
+    }
+  }
+  *out << '"';
+}
+
+std::string Base64(const std::vector<uint8_t>& data) {
+  static const char digits[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out;
+  out.reserve((data.size() + 2) / 3 * 4);
+  for (size_t i = 0; i < data.size(); i += 3) {
+    uint32_t bits = data[i] << 16;
+    if (i + 1 < data.size()) {
+      bits |= data[i + 1] << 8;
+    }
+    if (i + 2 < data.size()) {
+      bits |= data[i + 2];
+    }
+    out.push_back(digits[(bits >> 18) & 63]);
+    out.push_back(digits[(bits >> 12) & 63]);
+    out.push_back(i + 1 < data.size() ? digits[(bits >> 6) & 63] : '=');
+    out.push_back(i + 2 < data.size() ? digits[bits & 63] : '=');
+  }
+  return out;
+}
+
+// Saves the coaster to a new file named after kServeTrackToSave, created
+// exclusively so it never writes through a file or link that's already there.
+bool SaveServedTrack(const Td6& td6, std::string *path) {
+  *path = kServeTrackToSave;
+  int fd = mkstemps(&(*path)[0], kServeTrackSuffix);
+  if (fd < 0) {
+    return false;
+  }
+  std::vector<uint8_t> file = EncodeTd6(td6);
+  size_t written = 0;
+  while (written < file.size()) {
+    ssize_t n = write(fd, file.data() + written, file.size() - written);
+    if (n <= 0) {
+      break;
+    }
+    written += n;
+  }
+  if (close(fd) != 0 || written < file.size()) {
+    unlink(path->c_str());
+    return false;
+  }
+  return true;
+}
+
+// Generates the coaster of one request line and returns the response line:
+//   {"id": 7, "ok": true, "pieces": 112, "seconds": 0.04,
+//    "excitement": 6.4, "intensity": 6.9, "nausea": 4, "stats": {...},
+//    "path": "/tmp/serve_Gx3kQ2.td6"}
+// with "td6" and the file in base64 instead of "path" for "bytes" requests,
+// or {"id": 7, "ok": false, "error": "..."}.
+std::string HandleRequest(
+  const std::string& line,
+  const GeneratorOptions& defaults,
+  Td6 *td6) {
+
+  auto start = std::chrono::steady_clock::now();
+  ServeRequest request;
+  std::string error;
+  GeneratorResult result;
+  GeneratorStats stats;
+  if (ParseRequest(line, defaults, &request, &error)) {
+    result = Generate(request.options, &stats);
+    if (result.tracks.empty()) {
+      error = "no coaster found";
+    }
+  }
+
+  std::ostringstream out;
+  out << "{\"id\": " << request.id;
+  if (!error.empty()) {
+    out << ", \"ok\": false, \"error\": ";
+    WriteJsonString(error, &out);
+    out << "}\n";
+    return out.str();
+  }
+
+  td6->tracks = result.tracks;
+  std::string path;
+  if (!request.bytes && !SaveServedTrack(*td6, &path)) {
+    out << ", \"ok\": false, \"error\": \"failed saving track\"}\n";
+    return out.str();
+  }
+
+  std::chrono::duration<double> elapsed =
+    std::chrono::steady_clock::now() - start;
+  const RideRatings& ratings = result.ratings;
+  out << ", \"ok\": true, \"pieces\": " << result.tracks.size()
+    << ", \"seconds\": " << elapsed.count()
+    << ", \"excitement\": " << ratings.excitement
+    << ", \"intensity\": " << ratings.intensity
+    << ", \"nausea\": " << ratings.nausea << ", \"stats\": ";
+  WriteStatsJson(stats, &out);
+  if (request.bytes) {
+    out << ", \"td6\": \"" << Base64(EncodeTd6(*td6)) << "\"}\n";
+  } else {
+    out << ", \"path\": ";
+    WriteJsonString(path, &out);
+    out << "}\n";
+  }
+  return out.str();
+}
+
+// The responses go to the standard output, and anything the generator
+// prints to the standard error, so it can't get mixed into them.
+int ServeStream(const GeneratorOptions& defaults, Td6 *td6) {
+  std::ostream responses(std::cout.rdbuf());
+  std::cout.rdbuf(std::cerr.rdbuf());
+  std::string line;
+  while (std::getline(std::cin, line)) {
+    if (line.find_first_not_of(" \t\r") == std::string::npos) {
+      continue;
+    }
+    responses << HandleRequest(line, defaults, td6) << std::flush;
+  }
+  std::cout.rdbuf(responses.rdbuf());
+  return 0;
+}
+
+bool WriteAll(int fd, const std::string& data) {
+  size_t written = 0;
+  while (written < data.size()) {
+    ssize_t n = send(fd, data.data() + written, data.size() - written,
+      MSG_NOSIGNAL);
+    if (n <= 0) {
+      return false;
+    }
+    written += n;
+  }
+  return true;
+}
+
+// Answers every line of one connection until the client hangs up.
+void ServeConnection(int fd, const GeneratorOptions& defaults, Td6 *td6) {
+  std::string pending;
+  char buffer[kReadBufferSize];
+  ssize_t n;
+  while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+    pending.append(buffer, n);
+    size_t end;
+    while ((end = pending.find('\n')) != std::string::npos) {
+      std::string line = pending.substr(0, end);
+      pending.erase(0, end + 1);
+      if (line.find_first_not_of(" \t\r") == std::string::npos) {
+        continue;
+      }
+      if (!WriteAll(fd, HandleRequest(line, defaults, td6))) {
+        return;
+      }
+    }
+    if (pending.size() > kMaxRequestSize) {
+      WriteAll(fd, "{\"id\": null, \"ok\": false, "
+        "\"error\": \"request too long\"}\n");
+      return;
+    }
+  }
+}
+
+int ServeSocket(
+  const GeneratorOptions& defaults,
+  Td6 *td6,
+  const std::string& socketPath) {
+
+  sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  if (socketPath.size() >= sizeof(address.sun_path)) {
+    std::cout << "Socket path too long" << std::endl;
+    return -1;
+  }
+  std::strcpy(address.sun_path, socketPath.c_str());
+
+  int server = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (server < 0) {
+    std::cout << "Couldn't create a socket" << std::endl;
+    return -1;
+  }
+  // Only a socket left behind by an earlier run is replaced, never any other
+  // file that happens to be at the path.
+  struct stat status;
+  if (lstat(socketPath.c_str(), &status) == 0) {
+    if (!S_ISSOCK(status.st_mode)) {
+      std::cout << socketPath << " exists and isn't a socket" << std::endl;
+      close(server);
+      return -1;
+    }
+    unlink(socketPath.c_str());
+  }
+  // Clients can't connect until listen(), so the socket is only ever
+  // reachable by the user running the server.
+  if (bind(server, reinterpret_cast<sockaddr *>(&address),
+           sizeof(address)) != 0
+      || chmod(socketPath.c_str(), 0600) != 0
+      || listen(server, SOMAXCONN) != 0) {
+    std::cout << "Couldn't listen on " << socketPath << std::endl;
+    close(server);
+    return -1;
+  }
+  std::cout << "Listening on " << socketPath << std::endl;
+
+  int fd;
+  while ((fd = accept(server, nullptr, nullptr)) >= 0) {
+    ServeConnection(fd, defaults, td6);
+    close(fd);
+  }
+  close(server);
+  return 0;
+}
+
+int Serve(
+  const GeneratorOptions& defaults,
+  const Td6& td6,
+  const std::string& socketPath) {
+
+  Td6 coaster = td6;
+  if (socketPath.empty()) {
+    return ServeStream(defaults, &coaster);
+  }
+  return ServeSocket(defaults, &coaster, socketPath);
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+
+#include "Generator.h"
+#include "Td6.h"
+
+/*
+ * Declarations
+ */
+
+// Generates coasters on request until the input ends, so the template is
+// parsed only once. The tables of each grid size stay mapped from the table
+// cache once loaded; without a cache, only the last grid size's are kept and
+// switching sizes rebuilds them.
+// Requests and responses are JSON objects, one per line. They're read from
+// the standard input and answered on the standard output, or with a
+// `socketPath`, read from every connection to a Unix domain socket there, one
+// connection at a time. Fields a request leaves out keep the values of
+// `defaults`. The coasters are `td6` with their track elements replaced.
+int Serve(
+  const GeneratorOptions& defaults,
+  const Td6& td6,
+  const std::string& socketPath);
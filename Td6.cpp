@@ -0,0 +1,234 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#include "Td6.h"
+
+/*
+ * Constants
+ */
+
+// The checksum of a TD6 file is off by this much from that of other
+// RCT2 files.
+constexpr uint32_t kTd6ChecksumOffset = 0x1D4C1;
+constexpr size_t kChecksumSize = 4;
+// Longest run of repeated or literal bytes an encoded chunk holds.
+constexpr size_t kMaxRepeat = 125;
+
+/*
+ * Declarations
+ */
+
+bool DecodeRle(
+  const uint8_t *src,
+  size_t size,
+  std::vector<uint8_t> *out);
+
+void EncodeRle(const std::vector<uint8_t>& src, std::vector<uint8_t> *out);
+
+uint32_t Td6Checksum(const uint8_t *data, size_t size);
+
+bool ReadTd6File(const char *path, std::vector<uint8_t> *file);
+
+bool SameTd6(const Td6& a, const Td6& b);
+
+/*
+ * Definitions
+ */
+
+// A byte with the high bit set repeats the next byte 257 - byte times,
+// anything else is followed by byte + 1 bytes to copy as they are.
+bool DecodeRle(
+  const uint8_t *src,
+  size_t size,
+  std::vector<uint8_t> *out) {
+  size_t i = 0;
+  while (i < size) {
+    uint8_t code = src[i++];
+    if (code & 0x80) {
+      if (i >= size) {
+        return false;
+      }
+      out->insert(out->end(), 257 - code, src[i++]);
+    } else {
+      size_t count = code + 1;
+      if (i + count > size) {
+        return false;
+      }
+      out->insert(out->end(), src + i, src + i + count);
+      i += count;
+    }
+  }
+  return true;
+}
+
+// Matches the game's encoder, so an unchanged file is written back byte for
+// byte.
+void EncodeRle(const std::vector<uint8_t>& src, std::vector<uint8_t> *out) {
+  const uint8_t *begin = src.data();
+  const uint8_t *end = begin + src.size();
+  const uint8_t *literal = begin;
+  size_t count = 0;
+  auto flushLiteral = [&]() {
+    out->push_back(static_cast<uint8_t>(count - 1));
+    out->insert(out->end(), literal, literal + count);
+    literal += count;
+    count = 0;
+  };
+
+  const uint8_t *p = begin;
+  while (end - p > 1) {
+    if ((count != 0 && p[0] == p[1]) || count > kMaxRepeat) {
+      flushLiteral();
+    }
+    if (p[0] == p[1]) {
+      size_t repeat = 0;
+      while (repeat < kMaxRepeat && p + repeat < end && p[repeat] == p[0]) {
+        ++repeat;
+      }
+      out->push_back(static_cast<uint8_t>(257 - repeat));
+      out->push_back(p[0]);
+      p += repeat;
+      literal = p;
+    } else {
+      ++count;
+      ++p;
+    }
+  }
+  if (end - p == 1) {
+    ++count;
+  }
+  if (count != 0) {
+    flushLiteral();
+  }
+}
+
+// Every byte is added to the low byte of the sum, which is then rotated left
+// by 3.
+uint32_t Td6Checksum(const uint8_t *data, size_t size) {
+  uint32_t sum = 0;
+  for (size_t i = 0; i < size; ++i) {
+    sum = (sum & 0xFFFFFF00) | ((sum + data[i]) & 0xFF);
+    sum = (sum << 3) | (sum >> 29);
+  }
+  return sum - kTd6ChecksumOffset;
+}
+
+bool DecodeTd6(const std::vector<uint8_t>& file, Td6 *td6) {
+  if (file.size() < kChecksumSize) {
+    std::cerr << "TD6 file too short" << std::endl;
+    return false;
+  }
+  size_t size = file.size() - kChecksumSize;
+  uint32_t checksum;
+  std::memcpy(&checksum, file.data() + size, kChecksumSize);
+  if (checksum != Td6Checksum(file.data(), size)) {
+    std::cerr << "TD6 checksum mismatch" << std::endl;
+    return false;
+  }
+
+  std::vector<uint8_t> data;
+  if (!DecodeRle(file.data(), size, &data) || data.size() < kTd6HeaderSize) {
+    std::cerr << "TD6 data cut short" << std::endl;
+    return false;
+  }
+  td6->header.assign(data.begin(), data.begin() + kTd6HeaderSize);
+
+  size_t i = kTd6HeaderSize;
+  td6->tracks.clear();
+  while (i < data.size() && data[i] != kTd6EndOfList) {
+    if (i + 2 > data.size()) {
+      std::cerr << "TD6 track elements cut short" << std::endl;
+      return false;
+    }
+    td6->tracks.push_back({data[i], data[i + 1]});
+    i += 2;
+  }
+  size_t entrances = ++i;
+  while (i < data.size() && data[i] != kTd6EndOfList) {
+    i += kTd6EntranceSize;
+  }
+  if (i >= data.size()) {
+    std::cerr << "TD6 entrances cut short" << std::endl;
+    return false;
+  }
+  td6->entrances.assign(data.begin() + entrances, data.begin() + i);
+  td6->scenery.assign(data.begin() + i + 1, data.end());
+  return true;
+}
+
+std::vector<uint8_t> EncodeTd6(const Td6& td6) {
+  std::vector<uint8_t> data = td6.header;
+  for (const TrackDesignTrackElement& track : td6.tracks) {
+    data.push_back(static_cast<uint8_t>(track.type));
+    data.push_back(track.flags);
+  }
+  data.push_back(kTd6EndOfList);
+  data.insert(data.end(), td6.entrances.begin(), td6.entrances.end());
+  data.push_back(kTd6EndOfList);
+  data.insert(data.end(), td6.scenery.begin(), td6.scenery.end());
+
+  std::vector<uint8_t> file;
+  EncodeRle(data, &file);
+  uint32_t checksum = Td6Checksum(file.data(), file.size());
+  file.resize(file.size() + kChecksumSize);
+  std::memcpy(file.data() + file.size() - kChecksumSize, &checksum,
+    kChecksumSize);
+  return file;
+}
+
+bool ReadTd6File(const char *path, std::vector<uint8_t> *file) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    std::cerr << "Can't open " << path << std::endl;
+    return false;
+  }
+  file->assign(
+    (std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  return true;
+}
+
+bool SameTd6(const Td6& a, const Td6& b) {
+  auto sameTrack = [](const TrackDesignTrackElement& x,
+                      const TrackDesignTrackElement& y) {
+    return x.type == y.type && x.flags == y.flags;
+  };
+  return a.header == b.header && a.entrances == b.entrances
+    && a.scenery == b.scenery && a.tracks.size() == b.tracks.size()
+    && std::equal(a.tracks.begin(), a.tracks.end(), b.tracks.begin(),
+      sameTrack);
+}
+
+bool LoadTd6(const char *path, Td6 *td6) {
+  std::vector<uint8_t> file;
+  return ReadTd6File(path, &file) && DecodeTd6(file, td6);
+}
+
+bool SaveTd6(const Td6& td6, const char *path) {
+  std::vector<uint8_t> file = EncodeTd6(td6);
+  std::ofstream out(path, std::ios::binary);
+  out.write(reinterpret_cast<const char*>(file.data()), file.size());
+  return static_cast<bool>(out);
+}
+
+bool CheckTd6RoundTrip(const char *path) {
+  std::vector<uint8_t> file;
+  Td6 td6;
+  if (!ReadTd6File(path, &file) || !DecodeTd6(file, &td6)) {
+    return false;
+  }
+  std::vector<uint8_t> encoded = EncodeTd6(td6);
+  if (encoded != file) {
+    std::cerr << path << " isn't encoded back to the same bytes" << std::endl;
+    return false;
+  }
+  Td6 decoded;
+  if (!DecodeTd6(encoded, &decoded) || !SameTd6(td6, decoded)) {
+    std::cerr << path << " doesn't decode the same after encoding"
+      << std::endl;
+    return false;
+  }
+  return true;
+}
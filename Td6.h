@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <openrct2/ride/TrackDesign.h>
+
+/*
+ * Constants
+ */
+
+// The fixed header of a decoded TD6 file, before the track elements. Its
+// fields (ride type, vehicles, colours, stats, ...) are kept as they are.
+constexpr size_t kTd6HeaderSize = 0xA3;
+// Ends the lists of track elements, entrances and scenery.
+constexpr uint8_t kTd6EndOfList = 0xFF;
+// Every entrance and exit is this many bytes.
+constexpr size_t kTd6EntranceSize = 6;
+
+/*
+ * Types
+ */
+
+// A TD6 track design, as far as the generator cares about it. Everything but
+// the track elements is kept as raw bytes, so a file can be written back
+// without knowing what's in them.
+struct Td6 {
+  std::vector<uint8_t> header;
+  std::vector<TrackDesignTrackElement> tracks;
+  // kTd6EntranceSize bytes per entrance, without the end of the list.
+  std::vector<uint8_t> entrances;
+  // The scenery and anything else after the entrances, with its end of list.
+  std::vector<uint8_t> scenery;
+};
+
+/*
+ * Declarations
+ */
+
+// Reads and decodes the file at `path`. Returns false, with a message on the
+// standard error, if it can't be read, its checksum is wrong or it's cut
+// short.
+bool LoadTd6(const char *path, Td6 *td6);
+
+// Encodes `td6` and writes it to `path`.
+bool SaveTd6(const Td6& td6, const char *path);
+
+// Converts between the bytes of a TD6 file, run-length encoded and followed
+// by a checksum, and a Td6.
+bool DecodeTd6(const std::vector<uint8_t>& file, Td6 *td6);
+std::vector<uint8_t> EncodeTd6(const Td6& td6);
+
+// Checks that the file at `path` decodes, encodes back to the same bytes and
+// that those decode to the same Td6. Returns false, with a message on the
+// standard error, if any of it fails.
+bool CheckTd6RoundTrip(const char *path);